@@ -22,7 +22,8 @@ Main:
 .custom
     ;SEC 
     SBC.b #!BounceOffset
-    AND #$3F
+    CMP.b #!BounceCount
+    BCS .return
     %CallSprite(Ptr)
 .return
     JML $02904C|!BankB
@@ -45,7 +45,8 @@ Main:
 	;PHB : PHK : PLB       ; magic bank wrapper
 	;SEC                   ; \ Subtract 9. (Also allows you to use slots up to $88 instead of $7F in this version.)
 	SBC.b #!ClusterOffset ; / (Not that you'll ever use all of them though)
-	AND #$7F
+	CMP.b #!ClusterCount  ; \ Numbers past the pointer table
+	BCS .return           ; / do nothing.
 
 	%CallSprite(Ptr)
 
@@ -24,8 +24,10 @@ CapeInteract:
 	BCC .NotCustom
 	;SEC
 	SBC #!ExtendedOffset
-	AND #$7F
+	CMP.b #!ExtendedCount		; past the pointer table
+	BCS .OutOfRange
 	%CallExtCape(CapePtr)
+	.OutOfRange
 	JML $029653|!BankB
 	.NotCustom
 	CMP #$02			; restore vanilla code and jml back
@@ -43,8 +45,10 @@ Main:
 
 	;SEC
    SBC #!ExtendedOffset  ; 13 is the first custom one
-	AND #$7F              ;	
+	CMP.b #!ExtendedCount ; past the pointer table
+	BCS .OutOfRange       ;
 	%CallSprite(Ptr)      ;
+.OutOfRange
 	JML $029B15|!BankB           ; JML back to an RTS
 	
 .NotCustom
@@ -8,13 +8,16 @@ incsrc "pointer_caller.asm"
 org $02FFE2
     db "STSD"                        ;header!
     incbin "_versionflag.bin"    ;byte 1 is version number 1.xx
-                                        ;byte 2 are flags ---- ---l
+                                        ;byte 2 are flags ---- -rsl
                               ; l = per level sprites code inserted
-                              ;byte 3,4 reserved
+                              ; s = custom status pointer table truncated
+                              ; r = per level blocks are sized by the slots they use (see GetPerLevelAddr)
+                              ;byte 3 = custom status pointer table entries (if s is set)
+                              ;byte 4 = first per level sprite number (if r is set)
 
 ;$02FFEA
-TableLoc:
-       db $FF,$FF,$FF,$FF
+CoreHash:
+    incbin "_corehash.bin"     ;hash of the core patches' inputs, pixi skips re-applying them while it matches
 
 ;$02FFEE
     autoclean dl TableStart
@@ -23,8 +26,8 @@ TableLoc:
     ; but the above makes access easier and these are for cleanup.
    if !PerLevel == 1
         autoclean dl PerLevelLvlPtrs
-        dl $FFFFFF
-        dl $FFFFFF
+        dl PerLevelSprPtrs_data
+        dl PerLevelTable_data
         dl $FFFFFF
    else
         dl $FFFFFF
@@ -608,10 +611,10 @@ GetMainPtr:
     REP #$30
     AND #$00FF
 
-   if !PerLevel == 1
-      CMP #$00B0
+   if !PerLevelLookup == 1
+      CMP.w #!PerLevelFirst
       BCC .normal
-      CMP #$00C0
+      CMP.w #!PerLevelLast+1
       BCC .perlevel
    .normal
    endif
@@ -629,7 +632,7 @@ GetMainPtr:
     RTS
 
 
-   if !PerLevel == 1
+   if !PerLevelLookup == 1
     .perlevel
         JSR GetPerLevelAddr
         BNE +
@@ -651,8 +654,12 @@ GetMainPtr:
 
 
 
-if !PerLevel == 1
-    ; Input, A=Sprite number (inbetween B0-BF)
+if !PerLevelLookup == 1
+    ; Input, A=Sprite number (inside the per-level range), 16 bit A and X/Y
+    ; Output, Y=offset+1 of the sprite in PerLevelTable or zero if the level doesn't have it, $00=Sprite number*2
+    ; The block of each level starts with (highest number it uses-first per-level number+1)*2, the size of the
+    ; pointers that follow it for each number from the first per-level number up to that one, so levels only take
+    ; room for the slots they use.
     GetPerLevelAddr:
         ASL
         STA $00
@@ -666,9 +673,20 @@ if !PerLevel == 1
         BEQ .return
         PLB
         ; now in PerLevelSprPtrs bank
-        ADC $00 ; carry cleared by ASL earlier
         TAY
-        LDA.w PerLevelSprPtrs-($B0*2),y
+        LDA $00
+        SEC
+        SBC.w #!PerLevelFirst*2
+        CMP.w PerLevelSprPtrs,y
+        BCS .none
+        TYA
+        ADC $00 ; carry cleared by the BCS above
+        TAY
+        LDA.w PerLevelSprPtrs+2-(!PerLevelFirst*2),y
+        TAY
+        RTS
+    .none
+        LDA #$0000
         TAY
         RTS
     .return
@@ -1021,10 +1039,10 @@ SetSpriteTables:
     AND #$00FF
 
 
-   if !PerLevel == 1
-      CMP #$00B0
+   if !PerLevelLookup == 1
+      CMP.w #!PerLevelFirst
       BCC .normal
-      CMP #$00C0
+      CMP.w #!PerLevelLast+1
       BCC .perlevel
    .normal
    endif
@@ -1083,7 +1101,7 @@ SetSpriteTables:
     PLY
     RTL
 
-   if !PerLevel == 1
+   if !PerLevelLookup == 1
     .perlevel
         JSR GetPerLevelAddr
         BNE +
@@ -1163,9 +1181,11 @@ SubHandleStatus:
     BMI CallMain                ;check bit 7, if set call main
     PHA
     LDA $02,s                    ;load sprite status
-    CMP #$07
-    BCC vanillaHandler
-    JMP ExecuteCustomPtr        ;execute custom ptr for states 07-09-0A-0B-0C
+    if !CustomStatusPtrs == 1
+        CMP #$07
+        BCC vanillaHandler
+        JMP ExecuteCustomPtr    ;execute custom ptr for states 07-09-0A-0B-0C
+    endif
     vanillaHandler:
     JSL $01D43E|!BankB            ;run vanilla code for states 02-06
     PLA                            ;extra_prop_2
@@ -1187,16 +1207,17 @@ CallMain:
     PEA $85C1                    ;/
     JML [!Base1]                ; goto sprite main code.
 
+if !CustomStatusPtrs == 1
 ExecuteCustomPtr:
 .CustomStatus
     STA $03                    ; load status in $03 and number in A
     LDA !new_sprite_num,x
-    if !PerLevel == 1
+    if !PerLevelLookup == 1
         REP #$30
         AND #$00FF
-        CMP #$00B0
+        CMP.w #!PerLevelFirst
         BCC .normal
-        CMP #$00BF
+        CMP.w #!PerLevelLast+1
         BCS .normal
         JSR GetPerLevelAddr
         BNE +
@@ -1213,6 +1234,14 @@ ExecuteCustomPtr:
         .normal
         SEP #$30
     endif
+    if !CustomStatusPtrCount < 256
+        ; the table only covers sprites up to the last one that uses it
+        CMP.b #!CustomStatusPtrCount
+        BCC .inTable
+        LDA !14C8,x
+        JMP vanillaHandler
+    .inTable
+    endif
     %CallStatusPtr(CustomStatusPtr, IndexPtrTable, vanillaHandler)
     .return
     PLA : PLA        ; destroy the previous 2 PHAs
@@ -1220,6 +1249,7 @@ ExecuteCustomPtr:
 
     IndexPtrTable:
         db $09, $FF, $00, $03, $06, $0C
+endif
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ; Keep extra bits around when setting the sprite tables during
 ; level loading
@@ -1279,10 +1309,10 @@ TestSilverCoinBit:
     AND #$00FF
 
 
-   if !PerLevel == 1
-      CMP #$00B0
+   if !PerLevelLookup == 1
+      CMP.w #!PerLevelFirst
       BCC .normal
-      CMP #$00C0
+      CMP.w #!PerLevelLast+1
       BCC .perlevel
    .normal
    endif
@@ -1294,7 +1324,7 @@ TestSilverCoinBit:
     PLP
     JML $02A9AB|!BankB
 
-   if !PerLevel == 1
+   if !PerLevelLookup == 1
    .perlevel
       JSR GetPerLevelAddr
       BNE +
@@ -1357,7 +1387,7 @@ CustomStatusPtr:
     incbin "_customstatusptr.bin"
 
 ; ---------------------------------------------------
-; per-level tables for sprite B0-BF 0x8000 bytes each.
+; per-level tables for the per-level sprite numbers, up to 0x8000 bytes each.
 ; ---------------------------------------------------
 
 if !PerLevel == 1
@@ -20,7 +20,8 @@ Main:
 .custom
     ;SEC 
     SBC.b #!MinorExtendedOffset     ; substract
-    AND #$3F                        ; self imposed limit
+    CMP.b #!MinorExtendedCount      ; past the pointer table
+    BCS .return
     %CallSprite(Ptr)
     JML $028B74|!BankB
 
@@ -1,4 +1,5 @@
 include
+includeonce
 
 ;input:  A     = Custom Sprite Number
 ;        X     = Sprite RAM Index
@@ -1,4 +1,9 @@
+includeonce
+
 !PerLevel ?= 0
+!PerLevelLookup ?= !PerLevel
+!CustomStatusPtrs ?= 1
+!CustomStatusPtrCount ?= 256
 !Disable255SpritesPerLevel ?= 0
 
 if !Disable255SpritesPerLevel
@@ -21,7 +21,8 @@ Main:
 .custom
     ;SEC 
     SBC.b #!ScoreOffset
-    AND #$1F
+    CMP.b #!ScoreCount
+    BCS .return
     %CallSprite(Ptr)
 .return
     JML $02ADC5|!BankB
@@ -21,7 +21,8 @@ Main:
 .custom
     ;SEC 
     SBC.b #!SmokeOffset             ; substract
-    AND #$1F                        ; self imposed limit
+    CMP.b #!SmokeCount              ; past the pointer table
+    BCS .return
     %CallSprite(Ptr)
 .return
     JML $0296D7|!BankB              ; both routines return
@@ -30,7 +30,8 @@ Main:
 .custom
     ;SEC 
     SBC.b #!SpinningCoinOffset      ; substract
-    AND #$1F                        ; self imposed limit
+    CMP.b #!SpinningCoinCount       ; past the pointer table
+    BCS .return
     %CallSprite(Ptr)
 .return
     JML $0299DF|!BankB
@@ -0,0 +1,225 @@
+#include "cfg.h"
+#include "config.h"
+#include "json.h"
+#include "json/base64.h"
+#include "lmdata.h"
+#include "map16.h"
+#include "structs.h"
+#include <benchmark/benchmark.h>
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// every input is generated from fixed seeds (or taken from unittests/testing_files) so runs can be compared
+namespace {
+
+constexpr unsigned SEED = 0x5049584Du;
+
+const fs::path& work_dir() {
+    static const fs::path dir = [] {
+        fs::path path = fs::temp_directory_path() / "pixi_benchmarks";
+        fs::create_directories(path / "sprites");
+        fs::copy_file(fs::path{PIXI_BENCHMARK_DATA_DIR} / "test.cfg", path / "sprites" / "test.cfg",
+                      fs::copy_options::overwrite_existing);
+        fs::copy_file(fs::path{PIXI_BENCHMARK_DATA_DIR} / "test.json", path / "sprites" / "test.json",
+                      fs::copy_options::overwrite_existing);
+        return path;
+    }();
+    return dir;
+}
+
+// a 4MB rom filled with random bytes, opened once for each mapper
+ROM& synthetic_rom(MapperType mapper) {
+    static std::array<std::unique_ptr<ROM>, 3> roms{};
+    auto& rom = roms[static_cast<size_t>(mapper)];
+    if (!rom) {
+        const fs::path path = work_dir() / "synthetic.smc";
+        if (!fs::exists(path)) {
+            std::vector<char> contents(4 * 1024 * 1024);
+            std::mt19937 rng{SEED};
+            for (char& c : contents)
+                c = static_cast<char>(rng());
+            std::ofstream{path, std::ios::binary}.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+        }
+        rom = std::make_unique<ROM>();
+        if (!rom->open(path.string()))
+            std::abort();
+        rom->mapper = mapper;
+    }
+    return *rom;
+}
+
+std::vector<int> random_pc_addresses(const ROM& rom, size_t count) {
+    std::mt19937 rng{SEED};
+    std::uniform_int_distribution<int> dist{0, rom.size - 4};
+    std::vector<int> addresses(count);
+    for (int& address : addresses)
+        address = dist(rng);
+    return addresses;
+}
+
+void clear_lists(std::vector<sprite>& sprites, std::array<std::vector<sprite>, FromEnum(ListType::__SIZE__) - 1>& others) {
+    for (sprite& spr : sprites)
+        spr.clear();
+    for (auto& list : others)
+        for (sprite& spr : list)
+            spr.clear();
+}
+
+} // namespace
+
+static void BM_SnesToPc(benchmark::State& state) {
+    const ROM& rom = synthetic_rom(static_cast<MapperType>(state.range(0)));
+    std::vector<int> snes_addresses{};
+    for (int pc : random_pc_addresses(rom, 4096))
+        snes_addresses.push_back(rom.pc_to_snes(pc, false));
+    for (auto _ : state) {
+        for (int address : snes_addresses)
+            benchmark::DoNotOptimize(rom.snes_to_pc(address, false));
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(snes_addresses.size()));
+}
+BENCHMARK(BM_SnesToPc)->ArgName("mapper")->DenseRange(0, 2);
+
+static void BM_PcToSnes(benchmark::State& state) {
+    const ROM& rom = synthetic_rom(static_cast<MapperType>(state.range(0)));
+    const std::vector<int> pc_addresses = random_pc_addresses(rom, 4096);
+    for (auto _ : state) {
+        for (int address : pc_addresses)
+            benchmark::DoNotOptimize(rom.pc_to_snes(address, false));
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(pc_addresses.size()));
+}
+BENCHMARK(BM_PcToSnes)->ArgName("mapper")->DenseRange(0, 2);
+
+static void BM_PointerSnes(benchmark::State& state) {
+    const ROM& rom = synthetic_rom(MapperType::lorom);
+    std::vector<int> snes_addresses{};
+    for (int pc : random_pc_addresses(rom, 4096))
+        snes_addresses.push_back(rom.pc_to_snes(pc));
+    for (auto _ : state) {
+        for (int address : snes_addresses)
+            benchmark::DoNotOptimize(rom.pointer_snes(address));
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(snes_addresses.size()));
+}
+BENCHMARK(BM_PointerSnes);
+
+// map16 pages where the first range(0) percent of the tiles are already used, looking for range(1) free tiles
+static void BM_FindFreeMap(benchmark::State& state) {
+    static map16 map[MAP16_SIZE];
+    const size_t used = MAP16_SIZE * static_cast<size_t>(state.range(0)) / 100;
+    for (size_t i = 0; i < MAP16_SIZE; i++)
+        map[i] = map16{};
+    for (size_t i = 0; i < used; i++)
+        map[i].top_left.tile = 1;
+    const size_t count = static_cast<size_t>(state.range(1));
+    for (auto _ : state)
+        benchmark::DoNotOptimize(find_free_map(map, MAP16_SIZE, count));
+}
+BENCHMARK(BM_FindFreeMap)->ArgNames({"used%", "count"})->ArgsProduct({{0, 50, 95}, {1, 4}});
+
+static void BM_Base64Decode(benchmark::State& state) {
+    std::vector<unsigned char> bytes(static_cast<size_t>(state.range(0)));
+    std::mt19937 rng{SEED};
+    for (unsigned char& b : bytes)
+        b = static_cast<unsigned char>(rng());
+    const std::string encoded = base64_encode(bytes.data(), static_cast<unsigned int>(bytes.size()));
+    for (auto _ : state)
+        benchmark::DoNotOptimize(base64_decode(encoded));
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(encoded.size()));
+}
+BENCHMARK(BM_Base64Decode)->Arg(64)->Arg(4096);
+
+static void BM_ReadCfgFile(benchmark::State& state) {
+    sprite spr{};
+    for (auto _ : state) {
+        spr.clear();
+        spr.cfg_file = (work_dir() / "sprites" / "test.cfg").string();
+        benchmark::DoNotOptimize(read_cfg_file(&spr));
+    }
+}
+BENCHMARK(BM_ReadCfgFile);
+
+static void BM_ReadJsonFile(benchmark::State& state) {
+    sprite spr{};
+    for (auto _ : state) {
+        spr.clear();
+        spr.cfg_file = (work_dir() / "sprites" / "test.json").string();
+        benchmark::DoNotOptimize(read_json_file(&spr));
+    }
+}
+BENCHMARK(BM_ReadJsonFile);
+
+static void BM_GenerateSscData(benchmark::State& state) {
+    sprite spr{};
+    spr.cfg_file = (work_dir() / "sprites" / "test.json").string();
+    spr.asm_file = "test.asm";
+    if (!read_json_file(&spr)) {
+        state.SkipWithError("couldn't read test.json");
+        return;
+    }
+    for (auto _ : state)
+        benchmark::DoNotOptimize(generate_ssc_data(&spr, 0x42, 0x300));
+}
+BENCHMARK(BM_GenerateSscData);
+
+// a patch with range(0) lines like the ones pixi writes for each sprite
+static void BM_PatchfileWrite(benchmark::State& state) {
+    const int lines = static_cast<int>(state.range(0));
+    for (auto _ : state) {
+        patchfile patch{"bench_patch.asm"};
+        for (int i = 0; i < lines; i++)
+            patch.fprintf("!pixi_sprite_%03X = $%06X ; %s\n", i, 0x108000 + i * 3, "sprites/test.asm");
+        patch.close();
+        benchmark::DoNotOptimize(patch.vfile().length);
+    }
+    state.SetItemsProcessed(state.iterations() * lines);
+}
+BENCHMARK(BM_PatchfileWrite)->Arg(16)->Arg(1024);
+
+// list.txt with range(0) normal sprites alternating between the cfg and the json test sprite
+static void BM_PopulateSpriteList(benchmark::State& state) {
+    const int count = static_cast<int>(state.range(0));
+    const fs::path list_path = work_dir() / ("list_" + std::to_string(count) + ".txt");
+    {
+        std::ofstream list{list_path};
+        for (int i = 0; i < count; i++) {
+            char line[32];
+            snprintf(line, sizeof(line), "%02X %s\n", i, i % 2 ? "test.json" : "test.cfg");
+            list << line;
+        }
+    }
+    PixiConfig config{};
+    config.reset();
+    config[PathType::Sprites] = (work_dir() / "sprites").generic_string() + "/";
+
+    std::vector<sprite> sprites(MAX_SPRITE_COUNT);
+    std::array<std::vector<sprite>, FromEnum(ListType::__SIZE__) - 1> others{};
+    std::array<sprite*, FromEnum(ListType::__SIZE__)> lists{};
+    lists[FromEnum(ListType::Sprite)] = sprites.data();
+    // the list only has normal sprites, the other lists just need to be big enough for populate_sprite_list
+    for (size_t i = 0; i < others.size(); i++) {
+        others[i].resize(SPRITE_COUNT);
+        lists[i + 1] = others[i].data();
+    }
+    for (auto _ : state) {
+        state.PauseTiming();
+        clear_lists(sprites, others);
+        state.ResumeTiming();
+        if (!populate_sprite_list(config.GetPaths(), lists, list_path.string(), nullptr)) {
+            state.SkipWithError("populate_sprite_list failed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_PopulateSpriteList)->Arg(16)->Arg(0xB0);
+
+BENCHMARK_MAIN();
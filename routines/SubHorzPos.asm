@@ -1,3 +1,4 @@
+;@inlinable
 ;Input:  None
 ;
 ;Output: Y   = 0 => Mario to the right of the sprite,
@@ -1,3 +1,4 @@
+;@inlinable
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ; $B829 - vertical mario/sprite position check - shared
 ; Y = 1 if mario below sprite??
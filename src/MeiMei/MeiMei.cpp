@@ -1,12 +1,15 @@
 
+#include <algorithm>
 #include <cstdio>
 #include <fstream>
 #include <iomanip>
+#include <numeric>
 #include <sstream>
 #include <string>
 #include <unordered_set>
 
 #include "../iohandler.h"
+#include "../task_graph.h"
 #include "MeiMei.h"
 
 #ifdef ASAR_USE_DLL
@@ -16,6 +19,8 @@
 #endif
 
 constexpr auto SPR_ADDR_LIMIT = 0x800;
+// levels rewritten by each MeiMei task, a level is a few hundred bytes so batches keep the overhead down
+constexpr size_t LEVELS_PER_TASK = 32;
 
 #define ERR(msg)                                                                                                       \
     {                                                                                                                  \
@@ -23,10 +28,6 @@ constexpr auto SPR_ADDR_LIMIT = 0x800;
         goto end;                                                                                                      \
     }
 
-#define ASSERT_SPR_DATA_ADDR_SIZE(val)                                                                                 \
-    if ((val) >= SPR_ADDR_LIMIT)                                                                                       \
-        ERR("Sprite data is too large!");
-
 bool& MeiMei::AlwaysRemap() {
     return MeiMei::always;
 }
@@ -51,6 +52,10 @@ std::string escapeDefines(const std::string& path) {
     return ss.str();
 }
 
+void MeiMei::configureThreads(unsigned threadCount) {
+    MeiMei::threads = threadCount;
+}
+
 void MeiMei::configureSa1Def(const std::string& pathToSa1Def) {
     std::string escapedPath = escapeDefines(pathToSa1Def);
     MeiMei::sa1DefPath = escapedPath;
@@ -65,7 +70,7 @@ bool MeiMei::patch(const patchfile& patch, const std::vector<patchfile>& patchfi
                    [](const auto& p) { return p.vfile(); });
     patchparams params{.structsize = sizeof(patchparams),
                        .patchloc = patch.path().c_str(),
-                       .romdata = reinterpret_cast<char*>(rom.real_data),
+                       .romdata = rom.asar_buffer(),
                        .buflen = MAX_ROM_SIZE,
                        .romlen = &rom.size,
                        .includepaths = nullptr,
@@ -79,8 +84,8 @@ bool MeiMei::patch(const patchfile& patch, const std::vector<patchfile>& patchfi
                        .warning_setting_count = 0,
                        .memory_files = memfiles.data(),
                        .memory_file_count = static_cast<int>(memfiles.size()),
-                       .override_checksum_gen = false,
-                       .generate_checksum = true};
+                       .override_checksum_gen = true, // pixi fixes the checksum before writing the rom
+                       .generate_checksum = false};
     if (!asar_patch_ex(&params)) {
         int error_count;
         const errordata* errors = asar_geterrors(&error_count);
@@ -108,46 +113,121 @@ struct AddressConstants {
     static constexpr int LevelSpriteDataPointerTable = 0x02EC00;      /* $05EC00 */
 };
 
-bool MeiMei::initialize(const char* rom_name) {
-    MeiMei::name = std::string(rom_name);
-
-    memset(prevEx, 0x03, 0x400);
-    memset(nowEx, 0x03, 0x400);
+int MeiMei::level_sprite_data(const ROM& rom, int level) {
+    int snes = (rom.read_byte(AddressConstants::LMLevelSpriteDataBankBytePointer + level) << 16) +
+               rom.read_word(AddressConstants::LevelSpriteDataPointerTable + level * 2);
+    return rom.snes_to_pc(snes, false);
+}
 
-    if (!prev.open(MeiMei::name))
-        return false;
-    if (prev.read_byte(AddressConstants::LMPresentFlagPointer) == 0x42) {
-        int addr = prev.snes_to_pc(prev.read_long(AddressConstants::LMSizeTableAddressPointer), false);
-        prev.read_data(prevEx, 0x0400, addr);
+bool MeiMei::index_levels(const ROM& rom, std::array<std::vector<int>, 0x400>& levels_using) const {
+    iohandler& io = iohandler::get_global();
+    std::unordered_set<int> sprDataPointers{};
+    for (int lv = 0; lv < 0x200; lv++) {
+        int sprAddrPC = level_sprite_data(rom, lv);
+        if (sprAddrPC == -1) {
+            io.error("Error: Sprite Data has invalid address.");
+            return false;
+        }
+        // levels that share their sprite data are remapped once, through the first one
+        if (!sprDataPointers.insert(sprAddrPC).second)
+            continue;
+
+        bool exlevelFlag = rom.read_byte(sprAddrPC) & 0x20;
+        int ofs = 1;
+        int count = 0;
+        while (true) {
+            if (ofs >= SPR_ADDR_LIMIT - 3 || ++count >= SPR_ADDR_LIMIT / 3) {
+                io.error("Error: Sprite data is too large!");
+                return false;
+            }
+            uint8_t sprCommonData[3];
+            rom.read_data(sprCommonData, 3, sprAddrPC + ofs);
+            if (sprCommonData[0] == 0xFF) {
+                if (!exlevelFlag || sprCommonData[1] == 0xFE)
+                    break;
+                ofs += 2;
+                rom.read_data(sprCommonData, 3, sprAddrPC + ofs);
+            }
+            int sprNum = ((sprCommonData[0] & 0x0C) << 6) | (sprCommonData[2]);
+            std::vector<int>& levels = levels_using[sprNum];
+            if (levels.empty() || levels.back() != lv)
+                levels.push_back(lv);
+            ofs += prevEx[sprNum];
+        }
     }
     return true;
 }
 
-int MeiMei::run() {
-    ROM rom;
-    iohandler& io = iohandler::get_global();
-    if (!rom.open(MeiMei::name))
-        return 1;
+void MeiMei::remap_level(const ROM& rom, level_data& level) const {
+    uint8_t sprAllData[SPR_ADDR_LIMIT]{};
+    uint8_t sprCommonData[3];
+    const int sprAddrPC = level.address;
+
+    sprAllData[0] = rom.read_byte(sprAddrPC);
+    int prevOfs = 1;
+    int nowOfs = 1;
+    bool exlevelFlag = sprAllData[0] & (uint8_t)0x20;
+    bool changeData = false;
+
+    while (true) {
+        rom.read_data(sprCommonData, 3, sprAddrPC + prevOfs);
+        if (nowOfs >= SPR_ADDR_LIMIT - 3) {
+            level.error = "Sprite data is too large!";
+            return;
+        }
 
-    int returnValue = MeiMei::run(rom);
+        if (sprCommonData[0] == 0xFF) {
+            sprAllData[nowOfs++] = 0xFF;
+            if (!exlevelFlag) {
+                break;
+            }
 
-    if (returnValue) {
-        prev.close();
-        io.error("\n\nError occurred in MeiMei.\n"
-                 "Your rom has reverted to before pixi insert.\n");
-        return returnValue;
+            sprAllData[nowOfs++] = sprCommonData[1];
+            if (sprCommonData[1] == 0xFE) {
+                break;
+            } else {
+                prevOfs += 2;
+                rom.read_data(sprCommonData, 3, sprAddrPC + prevOfs);
+            }
+        }
+
+        sprAllData[nowOfs++] = sprCommonData[0]; // YYYYEEsy
+        sprAllData[nowOfs++] = sprCommonData[1]; // XXXXSSSS
+        sprAllData[nowOfs++] = sprCommonData[2]; // NNNNNNNN
+
+        int sprNum = ((sprCommonData[0] & 0x0C) << 6) | (sprCommonData[2]);
+
+        // the old extra bytes are kept up to the new size, new ones are zeroed
+        changeData = changeData || nowEx[sprNum] != prevEx[sprNum];
+        for (int i = 3; i < nowEx[sprNum]; i++) {
+            sprAllData[nowOfs++] = i < prevEx[sprNum] ? rom.read_byte(sprAddrPC + prevOfs + i) : 0x00;
+            if (nowOfs >= SPR_ADDR_LIMIT) {
+                level.error = "Sprite data is too large!";
+                return;
+            }
+        }
+        prevOfs += prevEx[sprNum];
     }
 
-    rom.close();
-    return returnValue;
+    if (changeData)
+        level.data.assign(sprAllData, sprAllData + nowOfs);
+}
+
+void MeiMei::initialize(const ROM& rom) {
+    memset(prevEx, 0x03, 0x400);
+    memset(nowEx, 0x03, 0x400);
+
+    if (rom.read_byte(AddressConstants::LMPresentFlagPointer) == 0x42) {
+        int addr = rom.snes_to_pc(rom.read_long(AddressConstants::LMSizeTableAddressPointer), false);
+        rom.read_data(prevEx, 0x0400, addr);
+    }
 }
 
 int MeiMei::run(ROM& rom) {
     iohandler& io = iohandler::get_global();
-    ROM now;
-    if (!now.open(MeiMei::name))
-        return 1;
-    if (prev.read_byte(AddressConstants::LMPresentFlagPointer) == 0x42) {
+    // everything is read before the fixup patch is applied, so the sprite data is the one pixi left in rom
+    const ROM& now = rom;
+    if (now.read_byte(AddressConstants::LMPresentFlagPointer) == 0x42) {
         int addr = now.snes_to_pc(now.read_long(AddressConstants::LMSizeTableAddressPointer), false);
         now.read_data(nowEx, 0x0400, addr);
     }
@@ -166,86 +246,61 @@ int MeiMei::run(ROM& rom) {
     }
 
     if (changeEx || MeiMei::always) {
-        uint8_t sprAllData[SPR_ADDR_LIMIT]{};
-        uint8_t sprCommonData[3];
+        // only the levels that use a sprite whose size changed need their data rewritten
+        std::vector<int> levels{};
+        if (MeiMei::always) {
+            levels.resize(0x200);
+            std::iota(levels.begin(), levels.end(), 0);
+        } else {
+            std::array<std::vector<int>, 0x400> levels_using{};
+            if (!index_levels(now, levels_using))
+                goto end;
+            for (int sprNum = 0; sprNum < 0x400; sprNum++) {
+                if (prevEx[sprNum] != nowEx[sprNum])
+                    levels.insert(levels.end(), levels_using[sprNum].begin(), levels_using[sprNum].end());
+            }
+            std::sort(levels.begin(), levels.end());
+            levels.erase(std::unique(levels.begin(), levels.end()), levels.end());
+        }
+        io.debug("MeiMei: %zu levels use sprites whose size changed\n", levels.size());
+
+        // levels sharing their sprite data are remapped once, through the first one
+        std::vector<level_data> remapped{};
         std::unordered_set<int> sprDataPointers{};
+        for (int lv : levels) {
+            int sprAddrPC = level_sprite_data(now, lv);
+            if (sprAddrPC == -1) {
+                ERR("Sprite Data has invalid address.")
+            }
+            if (sprDataPointers.insert(sprAddrPC).second)
+                remapped.push_back(level_data{.level = lv, .address = sprAddrPC});
+        }
+
+        // each level only reads the rom, they're split in batches that are rewritten in parallel
+        {
+            task_graph tasks{MeiMei::threads};
+            for (size_t first = 0; first < remapped.size(); first += LEVELS_PER_TASK) {
+                const size_t last = std::min(first + LEVELS_PER_TASK, remapped.size());
+                tasks.add("MeiMei levels", [&, first, last] {
+                    for (size_t i = first; i < last; i++)
+                        remap_level(now, remapped[i]);
+                    return true;
+                });
+            }
+            (void)tasks.wait_all();
+        }
 
         patchfile meimei_patch{"_meimei_fixup.asm", patchfile::openflags::w, /* from_mei_mei= */ true};
         meimei_patch.fprintf("incsrc \"%s\"\n", MeiMei::sa1DefPath.c_str());
         std::vector<patchfile> meimei_fixup_patches{};
 
-        for (int lv = 0; lv < 0x200; lv++) {
-
-            int sprAddrSNES = (now.read_byte(AddressConstants::LMLevelSpriteDataBankBytePointer + lv) << 16) +
-                              now.read_word(AddressConstants::LevelSpriteDataPointerTable + lv * 2);
-            int sprAddrPC = now.snes_to_pc(sprAddrSNES, false);
-            if (sprAddrPC == -1) {
-                ERR("Sprite Data has invalid address.")
-            }
-            auto [_, inserted] = sprDataPointers.insert(sprAddrPC);
-            if (!inserted)
-                continue;
-
-            memset(sprAllData, 0, SPR_ADDR_LIMIT);
-
-            sprAllData[0] = now.read_byte(sprAddrPC);
-            int prevOfs = 1;
-            int nowOfs = 1;
-            bool exlevelFlag = sprAllData[0] & (uint8_t)0x20;
-            bool changeData = false;
-
-            while (true) {
-                now.read_data(sprCommonData, 3, sprAddrPC + prevOfs);
-                if (nowOfs >= SPR_ADDR_LIMIT - 3) {
-                    ERR("Sprite data is too large!")
-                }
-
-                if (sprCommonData[0] == 0xFF) {
-                    sprAllData[nowOfs++] = 0xFF;
-                    if (!exlevelFlag) {
-                        break;
-                    }
-
-                    sprAllData[nowOfs++] = sprCommonData[1];
-                    if (sprCommonData[1] == 0xFE) {
-                        break;
-                    } else {
-                        prevOfs += 2;
-                        now.read_data(sprCommonData, 3, sprAddrPC + prevOfs);
-                    }
-                }
-
-                sprAllData[nowOfs++] = sprCommonData[0]; // YYYYEEsy
-                sprAllData[nowOfs++] = sprCommonData[1]; // XXXXSSSS
-                sprAllData[nowOfs++] = sprCommonData[2]; // NNNNNNNN
-
-                int sprNum = ((sprCommonData[0] & 0x0C) << 6) | (sprCommonData[2]);
-
-                if (nowEx[sprNum] > prevEx[sprNum]) {
-                    changeData = true;
-                    int i;
-                    for (i = 3; i < prevEx[sprNum]; i++) {
-                        sprAllData[nowOfs++] = now.read_byte(sprAddrPC + prevOfs + i);
-                        ASSERT_SPR_DATA_ADDR_SIZE(nowOfs)
-                    }
-                    for (; i < nowEx[sprNum]; i++) {
-                        sprAllData[nowOfs++] = 0x00;
-                        ASSERT_SPR_DATA_ADDR_SIZE(nowOfs)
-                    }
-                } else if (nowEx[sprNum] < prevEx[sprNum]) {
-                    changeData = true;
-                    for (int i = 3; i < nowEx[sprNum]; i++) {
-                        sprAllData[nowOfs++] = now.read_byte(sprAddrPC + prevOfs + i);
-                        ASSERT_SPR_DATA_ADDR_SIZE(nowOfs)
-                    }
-                } else {
-                    for (int i = 3; i < nowEx[sprNum]; i++) {
-                        sprAllData[nowOfs++] = now.read_byte(sprAddrPC + prevOfs + i);
-                        ASSERT_SPR_DATA_ADDR_SIZE(nowOfs)
-                    }
-                }
-                prevOfs += prevEx[sprNum];
+        // the patches are generated in level order, so they're the same whatever order the levels were done in
+        for (const level_data& level : remapped) {
+            if (level.error != nullptr) {
+                ERR(level.error)
             }
+            const int lv = level.level;
+            const bool changeData = !level.data.empty();
 
             if (changeData) {
                 std::string lvlstr = std::to_string(lv);
@@ -254,7 +309,7 @@ int MeiMei::run(ROM& rom) {
                 binaryFileName.append(lvlstr);
                 binaryFileName.append(".bin");
                 patchfile binFile{binaryFileName, patchfile::openflags::wb, /* from_mei_mei= */ true};
-                binFile.fwrite(sprAllData, nowOfs);
+                binFile.fwrite(level.data.data(), level.data.size());
                 binFile.close();
 
                 // create patch for sprite data binary
@@ -313,6 +368,8 @@ int MeiMei::run(ROM& rom) {
     }
 end:
     if (revert) {
+        io.error("\n\nError occurred in MeiMei.\n"
+                 "Nothing has been written, your rom is unchanged.\n");
         return 1;
     }
 
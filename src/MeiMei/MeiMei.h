@@ -1,25 +1,44 @@
 #include "../structs.h"
+#include <array>
 #include <string>
+#include <vector>
 
 class MeiMei {
   private:
-    std::string name;
-    ROM prev;
     unsigned char prevEx[0x400];
     unsigned char nowEx[0x400];
     bool always;
     bool debug;
     bool keepTemp;
     std::string sa1DefPath;
+    unsigned threads = 0;
+
+    // a level's sprite data rewritten with the new extra byte sizes
+    struct level_data {
+        int level = 0;
+        int address = 0;             // pc address of the old sprite data
+        std::vector<uint8_t> data{}; // empty if none of its sprites changed size
+        const char* error = nullptr;
+    };
 
     bool patch(const patchfile& patch, const std::vector<patchfile>& patchfiles, ROM& rom);
-    int run(ROM &rom);
+    // pc address of the sprite data of a level, -1 if the pointer isn't valid
+    static int level_sprite_data(const ROM& rom, int level);
+    // walks the sprite data of every level once, with the sizes from before the insertion, and lists for each sprite
+    // number the levels that use it (levels sharing their data are only listed under the first one)
+    bool index_levels(const ROM& rom, std::array<std::vector<int>, 0x400>& levels_using) const;
+    // only reads rom, so several levels can be remapped at the same time
+    void remap_level(const ROM& rom, level_data& level) const;
 
   public:
-    [[nodiscard]] bool initialize(const char *n);
-    int run();
+    // reads the extra byte sizes of the rom before anything gets inserted
+    void initialize(const ROM& rom);
+    // remaps the sprite data of rom in memory, rom is left as it was if this fails
+    int run(ROM& rom);
     bool& Debug();
     bool& AlwaysRemap();
     bool& KeepTemp();
     void configureSa1Def(const std::string& pathToSa1Def);
+    // maximum number of threads the levels are remapped on, 0 means one per CPU core
+    void configureThreads(unsigned threadCount);
 };
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "cfg.h"
+#include "file_io.h"
 #include "iohandler.h"
 #include "paths.h"
 #include "structs.h"
@@ -6,7 +7,6 @@
 
 #include <array>
 #include <filesystem>
-#include <fstream>
 #include <string>
 
 /*
@@ -43,13 +43,14 @@ bool read_cfg_file(sprite* spr) {
 
     size_t line = 0;
 
-    std::ifstream cfg_stream(spr->cfg_file);
-    if (!cfg_stream) {
+    file_buffer cfg_contents{};
+    if (!cfg_contents.open(spr->cfg_file, false)) {
         io.error("Can't find CFG file %s, aborting insertion", spr->cfg_file.c_str());
         return false;
     }
+    line_reader cfg_lines{cfg_contents.view()};
     std::string current_line;
-    while (std::getline(cfg_stream, current_line) && line < handlers.size()) {
+    while (line < handlers.size() && cfg_lines.next(current_line)) {
         trim(current_line);
         if (current_line.empty() || current_line.length() == 0)
             continue;
@@ -45,6 +45,15 @@ template <typename T> constexpr auto ToEnum(std::underlying_type_t<T> val) {
 
 using strref = std::reference_wrapper<std::string>;
 
+// the normal sprite numbers that can be given per-level sprites with -pl, set with --perlevel-range
+struct per_level_range {
+    int first = 0xB0;
+    int last = 0xBF;
+    [[nodiscard]] bool contains(int number) const {
+        return number >= first && number <= last;
+    }
+};
+
 using namespace std::string_view_literals;
 struct DefaultPaths {
 
@@ -142,11 +151,24 @@ class PixiConfig {
         DisableMeiMei = false;
         DisableAllExtensionFiles = false;
         AllSpritesOnePatch = false;
+        FastRom = false;
+        PerLevelSlots = per_level_range{};
+        MiscCapacities = {};
+        PatchOnly = false;
+        StablePlacement = false;
+        ProfileFrames = 0;
+        Threads = 0;
         Routines = DEFAULT_ROUTINES;
         AsmDir = "";
         AsmDirPath = "";
         SymbolsType = "";
+        SymbolsIndexFile = "";
         AsarStdIncludes = "";
+        ManifestFile = "";
+        PerLevelRange = "B0-BF";
+        MiscCapacity = "";
+        BpsFile = "";
+        IpsFile = "";
         AsarStdDefines = "";
         for (size_t i = 0; i < FromEnum(PathType::__SIZE__); i++) {
             m_Paths[static_cast<PathType>(i)] = DefaultPaths::get(static_cast<PathType>(i));
@@ -180,10 +202,24 @@ class PixiConfig {
     bool DisableAllExtensionFiles = false;
     bool AllSpritesOnePatch = false;
     bool SearchForFilesInExePath = false;
+    bool FastRom = false;
+    bool PatchOnly = false;
+    bool StablePlacement = false;
+    per_level_range PerLevelSlots{};
+    // table size of each misc sprite type set with --misc-capacity, 0 = up to the highest slot in use
+    std::array<size_t, FromEnum(ListType::__SIZE__)> MiscCapacities{};
+    int ProfileFrames = 0;
+    int Threads = 0;
     int Routines = DEFAULT_ROUTINES;
     std::string AsmDir{};
     std::string AsmDirPath{};
     std::string SymbolsType{};
+    std::string SymbolsIndexFile{};
     std::string AsarStdIncludes{};
+    std::string ManifestFile{};
+    std::string PerLevelRange{"B0-BF"}; // parsed into PerLevelSlots
+    std::string MiscCapacity{};         // parsed into MiscCapacities
+    std::string BpsFile{};
+    std::string IpsFile{};
     std::string AsarStdDefines{};
 };
\ No newline at end of file
@@ -0,0 +1,983 @@
+#include "cpu65816.h"
+#include <array>
+
+// base cycle count of each opcode with 8-bit accumulator/index, page aligned direct page and no page crossing
+// clang-format off
+constexpr std::array<uint8_t, 0x100> base_cycles{
+//  x0 x1 x2 x3 x4 x5 x6 x7 x8 x9 xA xB xC xD xE xF
+    8, 6, 8, 4, 5, 3, 5, 6, 3, 2, 2, 4, 6, 4, 6, 5, // 0x
+    2, 5, 5, 7, 5, 4, 6, 6, 2, 4, 2, 2, 6, 4, 7, 5, // 1x
+    6, 6, 8, 4, 3, 3, 5, 6, 4, 2, 2, 5, 4, 4, 6, 5, // 2x
+    2, 5, 5, 7, 4, 4, 6, 6, 2, 4, 2, 2, 4, 4, 7, 5, // 3x
+    7, 6, 2, 4, 7, 3, 5, 6, 3, 2, 2, 3, 3, 4, 6, 5, // 4x
+    2, 5, 5, 7, 7, 4, 6, 6, 2, 4, 3, 2, 4, 4, 7, 5, // 5x
+    6, 6, 6, 4, 3, 3, 5, 6, 4, 2, 2, 6, 5, 4, 6, 5, // 6x
+    2, 5, 5, 7, 4, 4, 6, 6, 2, 4, 4, 2, 6, 4, 7, 5, // 7x
+    2, 6, 4, 4, 3, 3, 3, 6, 2, 2, 2, 3, 4, 4, 4, 5, // 8x
+    2, 6, 5, 7, 4, 4, 4, 6, 2, 5, 2, 2, 4, 5, 5, 5, // 9x
+    2, 6, 2, 4, 3, 3, 3, 6, 2, 2, 2, 4, 4, 4, 4, 5, // Ax
+    2, 5, 5, 7, 4, 4, 4, 6, 2, 4, 2, 2, 4, 4, 4, 5, // Bx
+    2, 6, 3, 4, 3, 3, 5, 6, 2, 2, 2, 3, 4, 4, 6, 5, // Cx
+    2, 5, 5, 7, 6, 4, 6, 6, 2, 4, 3, 3, 6, 4, 7, 5, // Dx
+    2, 6, 3, 4, 3, 3, 5, 6, 2, 2, 2, 3, 4, 4, 6, 5, // Ex
+    2, 5, 5, 7, 5, 4, 6, 6, 2, 4, 4, 2, 8, 4, 7, 5  // Fx
+};
+// clang-format on
+
+static constexpr bool is_alu_opcode(uint8_t opcode) {
+    if (opcode == 0x89) // BIT #, would be STA #
+        return false;
+    switch (opcode & 0x1F) {
+    case 0x01:
+    case 0x03:
+    case 0x05:
+    case 0x07:
+    case 0x09:
+    case 0x0D:
+    case 0x0F:
+    case 0x11:
+    case 0x12:
+    case 0x13:
+    case 0x15:
+    case 0x17:
+    case 0x19:
+    case 0x1D:
+    case 0x1F:
+        return true;
+    default:
+        return false;
+    }
+}
+
+void cpu65816::reset_native() {
+    E = false;
+    P = FLAG_M | FLAG_X | FLAG_I;
+    X &= 0xFF;
+    Y &= 0xFF;
+    cycles = 0;
+    stopped = cpu_stop::none;
+}
+
+uint8_t cpu65816::read8(uint32_t address) {
+    return m_bus.read(address & 0xFFFFFF);
+}
+
+uint16_t cpu65816::read16(uint32_t address) {
+    return static_cast<uint16_t>(read8(address) | (read8(address + 1) << 8));
+}
+
+uint32_t cpu65816::read24(uint32_t address) {
+    return read16(address) | (read8(address + 2) << 16);
+}
+
+void cpu65816::write8(uint32_t address, uint8_t value) {
+    m_bus.write(address & 0xFFFFFF, value);
+}
+
+void cpu65816::write16(uint32_t address, uint16_t value) {
+    write8(address, static_cast<uint8_t>(value));
+    write8(address + 1, static_cast<uint8_t>(value >> 8));
+}
+
+void cpu65816::push8(uint8_t value) {
+    write8(S, value);
+    S--;
+}
+
+void cpu65816::push16(uint16_t value) {
+    push8(static_cast<uint8_t>(value >> 8));
+    push8(static_cast<uint8_t>(value));
+}
+
+uint8_t cpu65816::pull8() {
+    S++;
+    return read8(S);
+}
+
+uint16_t cpu65816::pull16() {
+    uint16_t low = pull8();
+    return static_cast<uint16_t>(low | (pull8() << 8));
+}
+
+uint8_t cpu65816::fetch8() {
+    uint8_t value = read8((PB << 16) | PC);
+    PC++;
+    return value;
+}
+
+uint16_t cpu65816::fetch16() {
+    uint16_t low = fetch8();
+    return static_cast<uint16_t>(low | (fetch8() << 8));
+}
+
+uint32_t cpu65816::fetch24() {
+    uint32_t low = fetch16();
+    return low | (fetch8() << 16);
+}
+
+uint32_t cpu65816::effective_address(mode md, bool write) {
+    auto direct = [this](uint16_t offset) -> uint32_t {
+        if (D & 0xFF)
+            cycles++;
+        return static_cast<uint16_t>(D + offset);
+    };
+    auto indexed = [this, write](uint32_t base, uint16_t index) -> uint32_t {
+        uint32_t address = (base + index) & 0xFFFFFF;
+        // stores always take the extra cycle and it's already in the base count
+        if (!write && (!x8() || (base & 0xFF00) != (address & 0xFF00)))
+            cycles++;
+        return address;
+    };
+    switch (md) {
+    case mode::imm_m: {
+        uint32_t address = (PB << 16) | PC;
+        PC += m8() ? 1 : 2;
+        return address;
+    }
+    case mode::imm_x: {
+        uint32_t address = (PB << 16) | PC;
+        PC += x8() ? 1 : 2;
+        return address;
+    }
+    case mode::dp:
+        return direct(fetch8());
+    case mode::dp_x:
+        return static_cast<uint16_t>(direct(fetch8()) + X);
+    case mode::dp_y:
+        return static_cast<uint16_t>(direct(fetch8()) + Y);
+    case mode::dp_ind:
+        return (DB << 16) | read16(direct(fetch8()));
+    case mode::dp_ind_x:
+        return (DB << 16) | read16(static_cast<uint16_t>(direct(fetch8()) + X));
+    case mode::dp_ind_y:
+        return indexed((DB << 16) | read16(direct(fetch8())), Y);
+    case mode::dp_ind_long:
+        return read24(direct(fetch8()));
+    case mode::dp_ind_long_y:
+        return (read24(direct(fetch8())) + Y) & 0xFFFFFF;
+    case mode::abs:
+        return (DB << 16) | fetch16();
+    case mode::abs_x:
+        return indexed((DB << 16) | fetch16(), X);
+    case mode::abs_y:
+        return indexed((DB << 16) | fetch16(), Y);
+    case mode::abs_long:
+        return fetch24();
+    case mode::abs_long_x:
+        return (fetch24() + X) & 0xFFFFFF;
+    case mode::sr:
+        return static_cast<uint16_t>(S + fetch8());
+    case mode::sr_ind_y:
+        return (((DB << 16) | read16(static_cast<uint16_t>(S + fetch8()))) + Y) & 0xFFFFFF;
+    }
+    return 0;
+}
+
+uint16_t cpu65816::read_operand(uint32_t address, bool wide) {
+    return wide ? read16(address) : read8(address);
+}
+
+void cpu65816::write_operand(uint32_t address, uint16_t value, bool wide) {
+    if (wide)
+        write16(address, value);
+    else
+        write8(address, static_cast<uint8_t>(value));
+}
+
+void cpu65816::set_nz(uint16_t value, bool wide) {
+    P &= ~(FLAG_N | FLAG_Z);
+    if (wide) {
+        if (value == 0)
+            P |= FLAG_Z;
+        if (value & 0x8000)
+            P |= FLAG_N;
+    } else {
+        if ((value & 0xFF) == 0)
+            P |= FLAG_Z;
+        if (value & 0x80)
+            P |= FLAG_N;
+    }
+}
+
+void cpu65816::set_a(uint16_t value) {
+    if (m8())
+        A = static_cast<uint16_t>((A & 0xFF00) | (value & 0xFF));
+    else
+        A = value;
+    set_nz(value, !m8());
+}
+
+void cpu65816::set_p(uint8_t value) {
+    P = value;
+    if (E)
+        P |= FLAG_M | FLAG_X;
+    if (x8()) {
+        X &= 0xFF;
+        Y &= 0xFF;
+    }
+}
+
+uint16_t cpu65816::adc(uint16_t value) {
+    const bool wide = !m8();
+    const int bits = wide ? 16 : 8;
+    const uint32_t mask = wide ? 0xFFFF : 0xFF;
+    const uint32_t sign = wide ? 0x8000 : 0x80;
+    const uint32_t a = A & mask;
+    const uint32_t v = value & mask;
+    uint32_t result = 0;
+    uint32_t carry = P & FLAG_C;
+    if (P & FLAG_D) {
+        for (int shift = 0; shift < bits; shift += 4) {
+            uint32_t digit = ((a >> shift) & 0xF) + ((v >> shift) & 0xF) + carry;
+            carry = digit > 9 ? 1 : 0;
+            if (carry)
+                digit -= 10;
+            result |= (digit & 0xF) << shift;
+        }
+        result |= carry << bits;
+    } else {
+        result = a + v + carry;
+    }
+    P &= ~(FLAG_C | FLAG_V);
+    if (~(a ^ v) & (a ^ result) & sign)
+        P |= FLAG_V;
+    if (result > mask)
+        P |= FLAG_C;
+    return static_cast<uint16_t>(result & mask);
+}
+
+uint16_t cpu65816::sbc(uint16_t value) {
+    const bool wide = !m8();
+    const int bits = wide ? 16 : 8;
+    const uint32_t mask = wide ? 0xFFFF : 0xFF;
+    const uint32_t sign = wide ? 0x8000 : 0x80;
+    const uint32_t a = A & mask;
+    const uint32_t v = value & mask;
+    if (!(P & FLAG_D))
+        return adc(static_cast<uint16_t>(~v & mask));
+    uint32_t result = 0;
+    int borrow = (P & FLAG_C) ? 0 : 1;
+    for (int shift = 0; shift < bits; shift += 4) {
+        int digit = static_cast<int>((a >> shift) & 0xF) - static_cast<int>((v >> shift) & 0xF) - borrow;
+        borrow = digit < 0 ? 1 : 0;
+        if (borrow)
+            digit += 10;
+        result |= static_cast<uint32_t>(digit & 0xF) << shift;
+    }
+    const uint32_t binary = a + (~v & mask) + ((P & FLAG_C) ? 1 : 0);
+    P &= ~(FLAG_C | FLAG_V);
+    if ((a ^ v) & (a ^ binary) & sign)
+        P |= FLAG_V;
+    if (!borrow)
+        P |= FLAG_C;
+    return static_cast<uint16_t>(result & mask);
+}
+
+void cpu65816::compare(uint16_t reg, uint16_t value, bool wide) {
+    const uint32_t mask = wide ? 0xFFFF : 0xFF;
+    const uint32_t r = reg & mask;
+    const uint32_t v = value & mask;
+    P &= ~FLAG_C;
+    if (r >= v)
+        P |= FLAG_C;
+    set_nz(static_cast<uint16_t>((r - v) & mask), wide);
+}
+
+void cpu65816::branch(bool taken) {
+    auto offset = static_cast<int8_t>(fetch8());
+    if (taken) {
+        cycles++;
+        const auto target = static_cast<uint16_t>(PC + offset);
+        // only emulation mode pays for landing in another page
+        if (E && (target & 0xFF00) != (PC & 0xFF00))
+            cycles++;
+        PC = target;
+    }
+}
+
+// ORA, AND, EOR, ADC, STA, LDA, CMP and SBC share the same addressing mode layout in the low 5 bits of the opcode
+void cpu65816::alu_group(uint8_t opcode) {
+    mode md{};
+    switch (opcode & 0x1F) {
+    case 0x01:
+        md = mode::dp_ind_x;
+        break;
+    case 0x03:
+        md = mode::sr;
+        break;
+    case 0x05:
+        md = mode::dp;
+        break;
+    case 0x07:
+        md = mode::dp_ind_long;
+        break;
+    case 0x09:
+        md = mode::imm_m;
+        break;
+    case 0x0D:
+        md = mode::abs;
+        break;
+    case 0x0F:
+        md = mode::abs_long;
+        break;
+    case 0x11:
+        md = mode::dp_ind_y;
+        break;
+    case 0x12:
+        md = mode::dp_ind;
+        break;
+    case 0x13:
+        md = mode::sr_ind_y;
+        break;
+    case 0x15:
+        md = mode::dp_x;
+        break;
+    case 0x17:
+        md = mode::dp_ind_long_y;
+        break;
+    case 0x19:
+        md = mode::abs_y;
+        break;
+    case 0x1D:
+        md = mode::abs_x;
+        break;
+    default:
+        md = mode::abs_long_x;
+        break;
+    }
+    const bool wide = !m8();
+    const int operation = opcode >> 5;
+    const uint32_t address = effective_address(md, operation == 4);
+    if (wide)
+        cycles++;
+    if (operation == 4) { // STA
+        write_operand(address, A, wide);
+        return;
+    }
+    const uint16_t value = read_operand(address, wide);
+    switch (operation) {
+    case 0:
+        set_a(A | value);
+        break;
+    case 1:
+        set_a(A & value);
+        break;
+    case 2:
+        set_a(A ^ value);
+        break;
+    case 3:
+        set_a(adc(value));
+        break;
+    case 5:
+        set_a(value);
+        break;
+    case 6:
+        compare(A, value, wide);
+        break;
+    default:
+        set_a(sbc(value));
+        break;
+    }
+}
+
+void cpu65816::rmw(uint8_t opcode, uint32_t address) {
+    const bool wide = !m8();
+    const uint16_t sign = wide ? 0x8000 : 0x80;
+    const uint16_t mask = wide ? 0xFFFF : 0xFF;
+    if (wide)
+        cycles += 2;
+    uint16_t value = read_operand(address, wide);
+    const bool carry = (P & FLAG_C) != 0;
+    switch (opcode & 0xE0) {
+    case 0x00: // ASL / TSB / TRB
+        if ((opcode & 0x0F) == 0x04 || (opcode & 0x0F) == 0x0C) {
+            P &= ~FLAG_Z;
+            if ((value & A & mask) == 0)
+                P |= FLAG_Z;
+            if (opcode & 0x10)
+                value = static_cast<uint16_t>(value & ~A);
+            else
+                value = static_cast<uint16_t>(value | A);
+            write_operand(address, value, wide);
+            return;
+        }
+        P = static_cast<uint8_t>((P & ~FLAG_C) | ((value & sign) ? FLAG_C : 0));
+        value = static_cast<uint16_t>(value << 1);
+        break;
+    case 0x20: // ROL
+        P = static_cast<uint8_t>((P & ~FLAG_C) | ((value & sign) ? FLAG_C : 0));
+        value = static_cast<uint16_t>((value << 1) | (carry ? 1 : 0));
+        break;
+    case 0x40: // LSR
+        P = static_cast<uint8_t>((P & ~FLAG_C) | (value & 1));
+        value = static_cast<uint16_t>((value & mask) >> 1);
+        break;
+    case 0x60: // ROR
+        P = static_cast<uint8_t>((P & ~FLAG_C) | (value & 1));
+        value = static_cast<uint16_t>(((value & mask) >> 1) | (carry ? sign : 0));
+        break;
+    case 0xC0: // DEC
+        value--;
+        break;
+    default: // INC
+        value++;
+        break;
+    }
+    value &= mask;
+    set_nz(value, wide);
+    write_operand(address, value, wide);
+}
+
+void cpu65816::step() {
+    if (stopped != cpu_stop::none)
+        return;
+    const uint8_t opcode = fetch8();
+    last_opcode = opcode;
+    cycles += base_cycles[opcode];
+    if (is_alu_opcode(opcode)) {
+        alu_group(opcode);
+        return;
+    }
+    step_opcode(opcode);
+}
+
+void cpu65816::step_opcode(uint8_t opcode) {
+    const bool wide_a = !m8();
+    const bool wide_x = !x8();
+    auto load_index = [&](uint16_t& reg, mode md) {
+        uint32_t address = effective_address(md, false);
+        if (wide_x)
+            cycles++;
+        reg = read_operand(address, wide_x);
+        set_nz(reg, wide_x);
+    };
+    auto store = [&](uint16_t value, mode md, bool wide) {
+        uint32_t address = effective_address(md, true);
+        if (wide)
+            cycles++;
+        write_operand(address, value, wide);
+    };
+    auto compare_index = [&](uint16_t reg, mode md) {
+        uint32_t address = effective_address(md, false);
+        if (wide_x)
+            cycles++;
+        compare(reg, read_operand(address, wide_x), wide_x);
+    };
+    auto bit = [&](mode md) {
+        uint32_t address = effective_address(md, false);
+        if (wide_a)
+            cycles++;
+        uint16_t value = read_operand(address, wide_a);
+        P &= ~FLAG_Z;
+        if ((value & A & (wide_a ? 0xFFFF : 0xFF)) == 0)
+            P |= FLAG_Z;
+        if (md != mode::imm_m) {
+            const uint16_t sign = wide_a ? 0x8000 : 0x80;
+            P = static_cast<uint8_t>((P & ~(FLAG_N | FLAG_V)) | ((value & sign) ? FLAG_N : 0) |
+                                     ((value & (sign >> 1)) ? FLAG_V : 0));
+        }
+    };
+    auto transfer = [&](uint16_t& dst, uint16_t src, bool wide) {
+        if (wide)
+            dst = src;
+        else
+            dst = static_cast<uint16_t>((dst & 0xFF00) | (src & 0xFF));
+        set_nz(dst, wide);
+    };
+    auto transfer_index = [&](uint16_t& dst, uint16_t src) {
+        dst = wide_x ? src : static_cast<uint16_t>(src & 0xFF);
+        set_nz(dst, wide_x);
+    };
+    auto block_move = [&](int step) {
+        const uint8_t dst_bank = fetch8();
+        const uint8_t src_bank = fetch8();
+        DB = dst_bank;
+        cycles -= base_cycles[opcode];
+        do {
+            write8((dst_bank << 16) | Y, read8((src_bank << 16) | X));
+            X = static_cast<uint16_t>(X + step);
+            Y = static_cast<uint16_t>(Y + step);
+            if (!wide_x) {
+                X &= 0xFF;
+                Y &= 0xFF;
+            }
+            A--;
+            cycles += 7;
+        } while (A != 0xFFFF);
+    };
+    auto accumulator_rmw = [&](uint8_t op) {
+        const uint16_t mask = wide_a ? 0xFFFF : 0xFF;
+        const uint16_t sign = wide_a ? 0x8000 : 0x80;
+        uint16_t value = A & mask;
+        const bool carry = (P & FLAG_C) != 0;
+        switch (op) {
+        case 0x0A:
+            P = static_cast<uint8_t>((P & ~FLAG_C) | ((value & sign) ? FLAG_C : 0));
+            value = static_cast<uint16_t>(value << 1);
+            break;
+        case 0x2A:
+            P = static_cast<uint8_t>((P & ~FLAG_C) | ((value & sign) ? FLAG_C : 0));
+            value = static_cast<uint16_t>((value << 1) | (carry ? 1 : 0));
+            break;
+        case 0x4A:
+            P = static_cast<uint8_t>((P & ~FLAG_C) | (value & 1));
+            value = static_cast<uint16_t>(value >> 1);
+            break;
+        case 0x6A:
+            P = static_cast<uint8_t>((P & ~FLAG_C) | (value & 1));
+            value = static_cast<uint16_t>((value >> 1) | (carry ? sign : 0));
+            break;
+        case 0x1A:
+            value++;
+            break;
+        default:
+            value--;
+            break;
+        }
+        set_a(static_cast<uint16_t>(value & mask));
+    };
+
+    switch (opcode) {
+    // read-modify-write
+    case 0x04:
+    case 0x06:
+    case 0x14:
+    case 0x26:
+    case 0x46:
+    case 0x66:
+    case 0xC6:
+    case 0xE6:
+        rmw(opcode, effective_address(mode::dp, true));
+        break;
+    case 0x0C:
+    case 0x0E:
+    case 0x1C:
+    case 0x2E:
+    case 0x4E:
+    case 0x6E:
+    case 0xCE:
+    case 0xEE:
+        rmw(opcode, effective_address(mode::abs, true));
+        break;
+    case 0x16:
+    case 0x36:
+    case 0x56:
+    case 0x76:
+    case 0xD6:
+    case 0xF6:
+        rmw(opcode, effective_address(mode::dp_x, true));
+        break;
+    case 0x1E:
+    case 0x3E:
+    case 0x5E:
+    case 0x7E:
+    case 0xDE:
+    case 0xFE:
+        rmw(opcode, effective_address(mode::abs_x, true));
+        break;
+    case 0x0A:
+    case 0x2A:
+    case 0x4A:
+    case 0x6A:
+    case 0x1A:
+    case 0x3A:
+        accumulator_rmw(opcode);
+        break;
+
+    // loads, stores and compares of the index registers
+    case 0xA0:
+        load_index(Y, mode::imm_x);
+        break;
+    case 0xA2:
+        load_index(X, mode::imm_x);
+        break;
+    case 0xA4:
+        load_index(Y, mode::dp);
+        break;
+    case 0xA6:
+        load_index(X, mode::dp);
+        break;
+    case 0xAC:
+        load_index(Y, mode::abs);
+        break;
+    case 0xAE:
+        load_index(X, mode::abs);
+        break;
+    case 0xB4:
+        load_index(Y, mode::dp_x);
+        break;
+    case 0xB6:
+        load_index(X, mode::dp_y);
+        break;
+    case 0xBC:
+        load_index(Y, mode::abs_x);
+        break;
+    case 0xBE:
+        load_index(X, mode::abs_y);
+        break;
+    case 0x84:
+        store(Y, mode::dp, wide_x);
+        break;
+    case 0x86:
+        store(X, mode::dp, wide_x);
+        break;
+    case 0x8C:
+        store(Y, mode::abs, wide_x);
+        break;
+    case 0x8E:
+        store(X, mode::abs, wide_x);
+        break;
+    case 0x94:
+        store(Y, mode::dp_x, wide_x);
+        break;
+    case 0x96:
+        store(X, mode::dp_y, wide_x);
+        break;
+    case 0x64:
+        store(0, mode::dp, wide_a);
+        break;
+    case 0x74:
+        store(0, mode::dp_x, wide_a);
+        break;
+    case 0x9C:
+        store(0, mode::abs, wide_a);
+        break;
+    case 0x9E:
+        store(0, mode::abs_x, wide_a);
+        break;
+    case 0xC0:
+        compare_index(Y, mode::imm_x);
+        break;
+    case 0xC4:
+        compare_index(Y, mode::dp);
+        break;
+    case 0xCC:
+        compare_index(Y, mode::abs);
+        break;
+    case 0xE0:
+        compare_index(X, mode::imm_x);
+        break;
+    case 0xE4:
+        compare_index(X, mode::dp);
+        break;
+    case 0xEC:
+        compare_index(X, mode::abs);
+        break;
+    case 0x24:
+        bit(mode::dp);
+        break;
+    case 0x2C:
+        bit(mode::abs);
+        break;
+    case 0x34:
+        bit(mode::dp_x);
+        break;
+    case 0x3C:
+        bit(mode::abs_x);
+        break;
+    case 0x89:
+        bit(mode::imm_m);
+        break;
+
+    // increments and decrements of the index registers
+    case 0xE8:
+        transfer_index(X, static_cast<uint16_t>(X + 1));
+        break;
+    case 0xC8:
+        transfer_index(Y, static_cast<uint16_t>(Y + 1));
+        break;
+    case 0xCA:
+        transfer_index(X, static_cast<uint16_t>(X - 1));
+        break;
+    case 0x88:
+        transfer_index(Y, static_cast<uint16_t>(Y - 1));
+        break;
+
+    // transfers
+    case 0xAA:
+        transfer_index(X, A);
+        break;
+    case 0xA8:
+        transfer_index(Y, A);
+        break;
+    case 0x8A:
+        transfer(A, X, wide_a);
+        break;
+    case 0x98:
+        transfer(A, Y, wide_a);
+        break;
+    case 0x9B:
+        transfer_index(Y, X);
+        break;
+    case 0xBB:
+        transfer_index(X, Y);
+        break;
+    case 0xBA:
+        transfer_index(X, S);
+        break;
+    case 0x9A:
+        S = E ? static_cast<uint16_t>(0x0100 | (X & 0xFF)) : X;
+        break;
+    case 0x1B:
+        S = E ? static_cast<uint16_t>(0x0100 | (A & 0xFF)) : A;
+        break;
+    case 0x3B:
+        A = S;
+        set_nz(A, true);
+        break;
+    case 0x5B:
+        D = A;
+        set_nz(D, true);
+        break;
+    case 0x7B:
+        A = D;
+        set_nz(A, true);
+        break;
+    case 0xEB:
+        A = static_cast<uint16_t>((A >> 8) | (A << 8));
+        set_nz(A, false);
+        break;
+
+    // stack
+    case 0x48:
+        if (wide_a) {
+            cycles++;
+            push16(A);
+        } else {
+            push8(static_cast<uint8_t>(A));
+        }
+        break;
+    case 0xDA:
+        if (wide_x) {
+            cycles++;
+            push16(X);
+        } else {
+            push8(static_cast<uint8_t>(X));
+        }
+        break;
+    case 0x5A:
+        if (wide_x) {
+            cycles++;
+            push16(Y);
+        } else {
+            push8(static_cast<uint8_t>(Y));
+        }
+        break;
+    case 0x68:
+        if (wide_a) {
+            cycles++;
+            set_a(pull16());
+        } else {
+            set_a(pull8());
+        }
+        break;
+    case 0xFA:
+        if (wide_x)
+            cycles++;
+        X = wide_x ? pull16() : pull8();
+        set_nz(X, wide_x);
+        break;
+    case 0x7A:
+        if (wide_x)
+            cycles++;
+        Y = wide_x ? pull16() : pull8();
+        set_nz(Y, wide_x);
+        break;
+    case 0x08:
+        push8(P);
+        break;
+    case 0x28:
+        set_p(pull8());
+        break;
+    case 0x8B:
+        push8(DB);
+        break;
+    case 0xAB:
+        DB = pull8();
+        set_nz(DB, false);
+        break;
+    case 0x4B:
+        push8(PB);
+        break;
+    case 0x0B:
+        push16(D);
+        break;
+    case 0x2B:
+        D = pull16();
+        set_nz(D, true);
+        break;
+    case 0xF4:
+        push16(fetch16());
+        break;
+    case 0xD4: {
+        uint32_t address = effective_address(mode::dp, false);
+        push16(read16(address));
+        break;
+    }
+    case 0x62: {
+        uint16_t offset = fetch16();
+        push16(static_cast<uint16_t>(PC + offset));
+        break;
+    }
+
+    // flags
+    case 0x18:
+        P &= ~FLAG_C;
+        break;
+    case 0x38:
+        P |= FLAG_C;
+        break;
+    case 0x58:
+        P &= ~FLAG_I;
+        break;
+    case 0x78:
+        P |= FLAG_I;
+        break;
+    case 0xB8:
+        P &= ~FLAG_V;
+        break;
+    case 0xD8:
+        P &= ~FLAG_D;
+        break;
+    case 0xF8:
+        P |= FLAG_D;
+        break;
+    case 0xC2:
+        set_p(static_cast<uint8_t>(P & ~fetch8()));
+        break;
+    case 0xE2:
+        set_p(static_cast<uint8_t>(P | fetch8()));
+        break;
+    case 0xFB: {
+        const bool carry = (P & FLAG_C) != 0;
+        P = static_cast<uint8_t>((P & ~FLAG_C) | (E ? FLAG_C : 0));
+        E = carry;
+        if (E) {
+            S = static_cast<uint16_t>(0x0100 | (S & 0xFF));
+            set_p(P | FLAG_M | FLAG_X);
+        }
+        break;
+    }
+
+    // branches and jumps
+    case 0x10:
+        branch(!(P & FLAG_N));
+        break;
+    case 0x30:
+        branch(P & FLAG_N);
+        break;
+    case 0x50:
+        branch(!(P & FLAG_V));
+        break;
+    case 0x70:
+        branch(P & FLAG_V);
+        break;
+    case 0x90:
+        branch(!(P & FLAG_C));
+        break;
+    case 0xB0:
+        branch(P & FLAG_C);
+        break;
+    case 0xD0:
+        branch(!(P & FLAG_Z));
+        break;
+    case 0xF0:
+        branch(P & FLAG_Z);
+        break;
+    case 0x80:
+        branch(true);
+        break;
+    case 0x82: {
+        uint16_t offset = fetch16();
+        PC = static_cast<uint16_t>(PC + offset);
+        break;
+    }
+    case 0x4C:
+        PC = fetch16();
+        break;
+    case 0x5C: {
+        uint32_t target = fetch24();
+        PB = static_cast<uint8_t>(target >> 16);
+        PC = static_cast<uint16_t>(target);
+        break;
+    }
+    case 0x6C:
+        PC = read16(fetch16());
+        break;
+    case 0x7C: {
+        uint16_t pointer = static_cast<uint16_t>(fetch16() + X);
+        PC = read16((PB << 16) | pointer);
+        break;
+    }
+    case 0xDC: {
+        uint32_t target = read24(fetch16());
+        PB = static_cast<uint8_t>(target >> 16);
+        PC = static_cast<uint16_t>(target);
+        break;
+    }
+    case 0x20: {
+        uint16_t target = fetch16();
+        push16(static_cast<uint16_t>(PC - 1));
+        PC = target;
+        break;
+    }
+    case 0xFC: {
+        uint16_t pointer = fetch16();
+        push16(static_cast<uint16_t>(PC - 1));
+        PC = read16((PB << 16) | static_cast<uint16_t>(pointer + X));
+        break;
+    }
+    case 0x22: {
+        uint32_t target = fetch24();
+        push8(PB);
+        push16(static_cast<uint16_t>(PC - 1));
+        PB = static_cast<uint8_t>(target >> 16);
+        PC = static_cast<uint16_t>(target);
+        break;
+    }
+    case 0x60:
+        PC = static_cast<uint16_t>(pull16() + 1);
+        break;
+    case 0x6B:
+        PC = static_cast<uint16_t>(pull16() + 1);
+        PB = pull8();
+        break;
+    case 0x40:
+        set_p(pull8());
+        PC = pull16();
+        if (!E)
+            PB = pull8();
+        break;
+
+    // block moves
+    case 0x44:
+        block_move(-1);
+        break;
+    case 0x54:
+        block_move(1);
+        break;
+
+    // everything else
+    case 0xEA:
+        break;
+    case 0x42:
+        fetch8();
+        break;
+    case 0x00:
+        fetch8();
+        stopped = cpu_stop::brk;
+        break;
+    case 0x02:
+        fetch8();
+        stopped = cpu_stop::cop;
+        break;
+    case 0xCB:
+        stopped = cpu_stop::wai;
+        break;
+    case 0xDB:
+        stopped = cpu_stop::stp;
+        break;
+    default:
+        break;
+    }
+}
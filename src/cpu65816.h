@@ -0,0 +1,117 @@
+#ifndef CPU65816_H
+#define CPU65816_H
+#include <cstdint>
+
+// interface for everything the cpu can read from or write to, addresses are 24-bit SNES addresses
+class snes_bus {
+  public:
+    virtual uint8_t read(uint32_t address) = 0;
+    virtual void write(uint32_t address, uint8_t value) = 0;
+    virtual ~snes_bus() = default;
+};
+
+enum class cpu_stop { none, brk, cop, wai, stp };
+
+/**
+    Minimal 65816 interpreter, it only counts CPU cycles (not master clock cycles), so memory speed and DMA aren't
+    accounted for. Cycle counts follow the WDC datasheet: the base count of each opcode plus the penalties for 16-bit
+    accumulator/index, a non page aligned direct page, index page crossing and taken branches (crossing a page too in
+    emulation mode).
+    Interrupts aren't emulated, BRK/COP/WAI/STP just stop the cpu.
+*/
+class cpu65816 {
+    snes_bus& m_bus;
+
+  public:
+    static constexpr uint8_t FLAG_C = 0x01;
+    static constexpr uint8_t FLAG_Z = 0x02;
+    static constexpr uint8_t FLAG_I = 0x04;
+    static constexpr uint8_t FLAG_D = 0x08;
+    static constexpr uint8_t FLAG_X = 0x10;
+    static constexpr uint8_t FLAG_M = 0x20;
+    static constexpr uint8_t FLAG_V = 0x40;
+    static constexpr uint8_t FLAG_N = 0x80;
+
+    uint16_t A = 0;
+    uint16_t X = 0;
+    uint16_t Y = 0;
+    uint16_t S = 0x01FF;
+    uint16_t D = 0;
+    uint8_t DB = 0;
+    uint8_t PB = 0;
+    uint16_t PC = 0;
+    uint8_t P = FLAG_M | FLAG_X | FLAG_I;
+    bool E = false;
+
+    uint64_t cycles = 0;
+    uint8_t last_opcode = 0;
+    cpu_stop stopped = cpu_stop::none;
+
+    explicit cpu65816(snes_bus& bus) : m_bus{bus} {
+    }
+
+    // puts the cpu in native mode with 8-bit accumulator and index and clears the cycle counter
+    void reset_native();
+    // executes a single instruction
+    void step();
+
+    void push8(uint8_t value);
+    void push16(uint16_t value);
+    uint8_t pull8();
+    uint16_t pull16();
+
+    uint8_t read8(uint32_t address);
+    uint16_t read16(uint32_t address);
+    uint32_t read24(uint32_t address);
+    void write8(uint32_t address, uint8_t value);
+    void write16(uint32_t address, uint16_t value);
+
+  private:
+    enum class mode {
+        imm_m,
+        imm_x,
+        dp,
+        dp_x,
+        dp_y,
+        dp_ind,
+        dp_ind_x,
+        dp_ind_y,
+        dp_ind_long,
+        dp_ind_long_y,
+        abs,
+        abs_x,
+        abs_y,
+        abs_long,
+        abs_long_x,
+        sr,
+        sr_ind_y
+    };
+
+    bool m8() const {
+        return (P & FLAG_M) != 0;
+    }
+    bool x8() const {
+        return (P & FLAG_X) != 0;
+    }
+
+    uint8_t fetch8();
+    uint16_t fetch16();
+    uint32_t fetch24();
+    uint32_t effective_address(mode md, bool write);
+    uint16_t read_operand(uint32_t address, bool wide);
+    void write_operand(uint32_t address, uint16_t value, bool wide);
+
+    void set_nz(uint16_t value, bool wide);
+    void set_a(uint16_t value);
+    void set_p(uint8_t value);
+    uint16_t adc(uint16_t value);
+    uint16_t sbc(uint16_t value);
+    void compare(uint16_t reg, uint16_t value, bool wide);
+    void branch(bool taken);
+
+    void alu_group(uint8_t opcode);
+    void rmw(uint8_t opcode, uint32_t address);
+    void step_opcode(uint8_t opcode);
+};
+
+#endif
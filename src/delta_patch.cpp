@@ -0,0 +1,219 @@
+#include "delta_patch.h"
+#include "file_io.h"
+#include "hashing.h"
+#include "iohandler.h"
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+using bytes = std::span<const unsigned char>;
+
+namespace {
+
+// how many bytes starting at pos are the same in both
+size_t unchanged_length(bytes source, bytes target, size_t pos) {
+    const size_t end = std::min(source.size(), target.size());
+    if (pos >= end)
+        return 0;
+    return static_cast<size_t>(
+        std::mismatch(source.begin() + pos, source.begin() + end, target.begin() + pos).first -
+        (source.begin() + pos));
+}
+
+// where the changes starting at pos end, unchanged stretches shorter than min_unchanged are kept in the
+// changes because splitting them would cost more than storing those bytes again
+size_t changes_end(bytes source, bytes target, size_t pos, size_t min_unchanged) {
+    size_t end = pos;
+    while (end < target.size()) {
+        const size_t same = unchanged_length(source, target, end);
+        if (same >= min_unchanged || (same > 0 && end + same == target.size()))
+            break;
+        end += std::max<size_t>(same, 1);
+    }
+    return end;
+}
+
+// how many times the byte at pos is repeated from there, up to end
+size_t run_length(bytes data, size_t pos, size_t end) {
+    const unsigned char value = data[pos];
+    return static_cast<size_t>(std::find_if(data.begin() + pos, data.begin() + end,
+                                            [value](unsigned char c) { return c != value; }) -
+                               (data.begin() + pos));
+}
+
+void append(std::string& patch, bytes data, size_t start, size_t end) {
+    patch.append(reinterpret_cast<const char*>(data.data()) + start, end - start);
+}
+
+//------------------------------------------------------------------------------------------
+// BPS, as described in https://www.romhacking.net/documents/746/
+//------------------------------------------------------------------------------------------
+
+enum bps_action : uint64_t { source_read = 0, target_read = 1, source_copy = 2, target_copy = 3 };
+
+constexpr size_t BPS_MIN_UNCHANGED = 4;
+constexpr size_t BPS_MIN_RUN = 8;
+
+void bps_number(std::string& patch, uint64_t value) {
+    while (true) {
+        const auto low = static_cast<char>(value & 0x7F);
+        value >>= 7;
+        if (value == 0) {
+            patch.push_back(static_cast<char>(0x80 | low));
+            return;
+        }
+        patch.push_back(low);
+        value--;
+    }
+}
+
+void bps_action(std::string& patch, bps_action action, size_t length) {
+    bps_number(patch, ((static_cast<uint64_t>(length) - 1) << 2) | action);
+}
+
+void bps_u32(std::string& patch, uint32_t value) {
+    for (int i = 0; i < 4; i++)
+        patch.push_back(static_cast<char>((value >> (i * 8)) & 0xFF));
+}
+
+uint32_t crc32(const void* data, size_t size) {
+    crc32_hash hash{};
+    hash.update(data, size);
+    return hash.value();
+}
+
+//------------------------------------------------------------------------------------------
+// IPS
+//------------------------------------------------------------------------------------------
+
+constexpr size_t IPS_MAX_SIZE = 0x1000000;
+constexpr size_t IPS_MAX_RECORD = 0xFFFF;
+// a record starting here would be read as the "EOF" marker
+constexpr size_t IPS_EOF_OFFSET = 0x454F46;
+// each record has a 5 bytes header, a run record 3 more bytes
+constexpr size_t IPS_MIN_UNCHANGED = 6;
+constexpr size_t IPS_MIN_RUN = 16;
+
+void ips_offset(std::string& patch, size_t offset) {
+    patch.push_back(static_cast<char>((offset >> 16) & 0xFF));
+    patch.push_back(static_cast<char>((offset >> 8) & 0xFF));
+    patch.push_back(static_cast<char>(offset & 0xFF));
+}
+
+void ips_u16(std::string& patch, size_t value) {
+    patch.push_back(static_cast<char>((value >> 8) & 0xFF));
+    patch.push_back(static_cast<char>(value & 0xFF));
+}
+
+void ips_literal(std::string& patch, bytes target, size_t start, size_t end) {
+    while (start < end) {
+        // rewriting the byte before it with the same value is the usual way around the marker
+        if (start == IPS_EOF_OFFSET)
+            start--;
+        const size_t record_end = std::min(end, start + IPS_MAX_RECORD);
+        ips_offset(patch, start);
+        ips_u16(patch, record_end - start);
+        append(patch, target, start, record_end);
+        start = record_end;
+    }
+}
+
+void ips_run(std::string& patch, bytes target, size_t start, size_t length) {
+    while (length > 0) {
+        if (start == IPS_EOF_OFFSET) {
+            ips_literal(patch, target, start, start + 1);
+            start++;
+            length--;
+            continue;
+        }
+        const size_t count = std::min(length, IPS_MAX_RECORD);
+        ips_offset(patch, start);
+        ips_u16(patch, 0);
+        ips_u16(patch, count);
+        patch.push_back(static_cast<char>(target[start]));
+        start += count;
+        length -= count;
+    }
+}
+
+} // namespace
+
+void write_bps_patch(file_writer& out, bytes source, bytes target) {
+    std::string patch{"BPS1"};
+    bps_number(patch, source.size());
+    bps_number(patch, target.size());
+    bps_number(patch, 0); // no metadata
+
+    size_t target_relative = 0;
+    size_t pos = 0;
+    while (pos < target.size()) {
+        const size_t same = unchanged_length(source, target, pos);
+        if (same >= BPS_MIN_UNCHANGED || (same > 0 && pos + same == target.size())) {
+            bps_action(patch, source_read, same);
+            pos += same;
+            continue;
+        }
+        const size_t end = changes_end(source, target, pos, BPS_MIN_UNCHANGED);
+        size_t literal = pos;
+        while (pos < end) {
+            const size_t run = run_length(target, pos, end);
+            if (run >= BPS_MIN_RUN) {
+                // the first byte of the run is stored, the rest of it copies that byte over and over
+                bps_action(patch, target_read, pos + 1 - literal);
+                append(patch, target, literal, pos + 1);
+                bps_action(patch, target_copy, run - 1);
+                const int64_t offset = static_cast<int64_t>(pos) - static_cast<int64_t>(target_relative);
+                bps_number(patch, (static_cast<uint64_t>(offset < 0 ? -offset : offset) << 1) | (offset < 0 ? 1 : 0));
+                target_relative = pos + run - 1;
+                literal = pos + run;
+            }
+            pos += run;
+        }
+        if (literal < end) {
+            bps_action(patch, target_read, end - literal);
+            append(patch, target, literal, end);
+        }
+    }
+
+    bps_u32(patch, crc32(source.data(), source.size()));
+    bps_u32(patch, crc32(target.data(), target.size()));
+    bps_u32(patch, crc32(patch.data(), patch.size()));
+    out.write(patch);
+}
+
+bool write_ips_patch(file_writer& out, bytes source, bytes target) {
+    if (target.size() > IPS_MAX_SIZE) {
+        iohandler::get_global().error("The ROM is too big for an IPS patch (%zu bytes, the maximum is %zu), use a BPS "
+                                      "patch instead\n",
+                                      target.size(), IPS_MAX_SIZE);
+        return false;
+    }
+
+    std::string patch{"PATCH"};
+    size_t pos = 0;
+    while (pos < target.size()) {
+        const size_t same = unchanged_length(source, target, pos);
+        if (same >= IPS_MIN_UNCHANGED || (same > 0 && pos + same == target.size())) {
+            pos += same;
+            continue;
+        }
+        const size_t end = changes_end(source, target, pos, IPS_MIN_UNCHANGED);
+        size_t literal = pos;
+        while (pos < end) {
+            const size_t run = run_length(target, pos, end);
+            if (run >= IPS_MIN_RUN) {
+                ips_literal(patch, target, literal, pos);
+                ips_run(patch, target, pos, run);
+                literal = pos + run;
+            }
+            pos += run;
+        }
+        ips_literal(patch, target, literal, end);
+    }
+    patch += "EOF";
+    // truncation extension, understood by most patchers
+    if (target.size() < source.size())
+        ips_offset(patch, target.size());
+    out.write(patch);
+    return true;
+}
@@ -0,0 +1,29 @@
+#ifndef DELTA_PATCH_H
+#define DELTA_PATCH_H
+#include <span>
+
+class file_writer;
+
+/**
+    Writes a BPS patch that turns source into target. Bytes that didn't change are copied from the source,
+    changed bytes are stored as they are except for runs of the same byte (like the free space of an expanded rom)
+    which are stored once and then repeated.
+
+    @param out is where the patch is written
+    @param source is the rom as it was read
+    @param target is the rom as it's going to be written
+*/
+void write_bps_patch(file_writer& out, std::span<const unsigned char> source, std::span<const unsigned char> target);
+
+/**
+    Writes an IPS patch that turns source into target, with a truncation record if target is the smaller one.
+
+    @param out is where the patch is written
+    @param source is the rom as it was read
+    @param target is the rom as it's going to be written
+    @return false if target is too big for the 24 bit offsets of the format
+*/
+[[nodiscard]] bool write_ips_patch(file_writer& out, std::span<const unsigned char> source,
+                                   std::span<const unsigned char> target);
+
+#endif
@@ -1,41 +1,350 @@
 #include "file_io.h"
 #include "iohandler.h"
 #include "paths.h"
+#include <atomic>
 #include <cerrno>
+#include <chrono>
 #include <cstdio>
 #include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <utility>
+#include <vector>
 
-FILE* open(const char* name, const char* mode) {
-    FILE* file = fopen(name, mode);
+#ifdef ON_WINDOWS
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+struct atomic_io_stats {
+    std::atomic<uint64_t> bytes_read{0};
+    std::atomic<uint64_t> bytes_written{0};
+    std::atomic<uint64_t> files_read{0};
+    std::atomic<uint64_t> files_written{0};
+    std::atomic<uint64_t> nanoseconds{0};
+} g_io_stats{};
+
+class io_timer {
+    std::chrono::steady_clock::time_point m_start = std::chrono::steady_clock::now();
+
+  public:
+    ~io_timer() {
+        auto elapsed = std::chrono::steady_clock::now() - m_start;
+        g_io_stats.nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    }
+};
+
+// buffers of the small files that have been read and released, so that reading many cfg/asm files
+// doesn't allocate for each one of them
+class buffer_pool {
+    static constexpr size_t MAX_POOLED = 16;
+    std::mutex m_mutex{};
+    std::vector<std::vector<unsigned char>> m_buffers{};
+
+  public:
+    std::vector<unsigned char> acquire() {
+        std::lock_guard lock{m_mutex};
+        if (m_buffers.empty())
+            return {};
+        std::vector<unsigned char> buffer = std::move(m_buffers.back());
+        m_buffers.pop_back();
+        return buffer;
+    }
+    void release(std::vector<unsigned char>&& buffer) {
+        if (buffer.capacity() == 0 || buffer.capacity() > file_buffer::MMAP_THRESHOLD)
+            return;
+        buffer.clear();
+        std::lock_guard lock{m_mutex};
+        if (m_buffers.size() < MAX_POOLED)
+            m_buffers.push_back(std::move(buffer));
+    }
+} g_buffer_pool{};
+
+} // namespace
+
+io_stats get_io_stats() {
+    return {g_io_stats.bytes_read, g_io_stats.bytes_written, g_io_stats.files_read, g_io_stats.files_written,
+            g_io_stats.nanoseconds};
+}
+
+void reset_io_stats() {
+    g_io_stats.bytes_read = 0;
+    g_io_stats.bytes_written = 0;
+    g_io_stats.files_read = 0;
+    g_io_stats.files_written = 0;
+    g_io_stats.nanoseconds = 0;
+}
+
+file_buffer::file_buffer(file_buffer&& other) noexcept {
+    *this = std::move(other);
+}
+
+file_buffer& file_buffer::operator=(file_buffer&& other) noexcept {
+    if (this == &other)
+        return *this;
+    release();
+    m_data = std::exchange(other.m_data, nullptr);
+    m_size = std::exchange(other.m_size, 0);
+    m_storage = std::move(other.m_storage);
+    m_mapping = std::exchange(other.m_mapping, nullptr);
+#ifdef ON_WINDOWS
+    m_mapping_handle = std::exchange(other.m_mapping_handle, nullptr);
+#endif
+    return *this;
+}
+
+file_buffer::~file_buffer() {
+    release();
+}
+
+void file_buffer::release() {
+    if (m_mapping) {
+#ifdef ON_WINDOWS
+        UnmapViewOfFile(m_mapping);
+        CloseHandle(m_mapping_handle);
+        m_mapping_handle = nullptr;
+#else
+        munmap(m_mapping, m_size);
+#endif
+        m_mapping = nullptr;
+    }
+    g_buffer_pool.release(std::move(m_storage));
+    m_storage = {};
+    m_data = nullptr;
+    m_size = 0;
+}
+
+bool file_buffer::open(const std::string& path, bool report_errors) {
+    io_timer timer{};
+    release();
+    auto fail = [&](const char* what) {
+        if (report_errors)
+            iohandler::get_global().error("Could not %s \"%s\": %s\n", what, path.c_str(), strerror(errno));
+        return false;
+    };
+
+#ifdef ON_WINDOWS
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        errno = ENOENT;
+        return fail("open");
+    }
+    LARGE_INTEGER file_size{};
+    GetFileSizeEx(file, &file_size);
+    size_t size = static_cast<size_t>(file_size.QuadPart);
+    if (size >= MMAP_THRESHOLD) {
+        m_mapping_handle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (m_mapping_handle)
+            m_mapping = MapViewOfFile(m_mapping_handle, FILE_MAP_READ, 0, 0, 0);
+        if (!m_mapping && m_mapping_handle) {
+            CloseHandle(m_mapping_handle);
+            m_mapping_handle = nullptr;
+        }
+    }
+    if (!m_mapping) {
+        m_storage = g_buffer_pool.acquire();
+        m_storage.resize(size);
+        DWORD read = 0;
+        if (size > 0 &&
+            (!ReadFile(file, m_storage.data(), static_cast<DWORD>(size), &read, nullptr) || read != size)) {
+            CloseHandle(file);
+            errno = EIO;
+            return fail("read");
+        }
+    }
+    CloseHandle(file);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return fail("open");
+    struct stat st {};
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return fail("read");
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    if (size >= MMAP_THRESHOLD) {
+        void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED)
+            m_mapping = mapping;
+    }
+    if (!m_mapping) {
+        m_storage = g_buffer_pool.acquire();
+        m_storage.resize(size);
+        size_t done = 0;
+        while (done < size) {
+            ssize_t count = ::read(fd, m_storage.data() + done, size - done);
+            if (count <= 0) {
+                ::close(fd);
+                if (count == 0)
+                    errno = EIO;
+                return fail("read");
+            }
+            done += static_cast<size_t>(count);
+        }
+    }
+    ::close(fd);
+#endif
+
+    m_data = m_mapping ? static_cast<const unsigned char*>(m_mapping) : m_storage.data();
+    m_size = size;
+    g_io_stats.bytes_read += size;
+    g_io_stats.files_read++;
+    return true;
+}
+
+bool line_reader::next(std::string& line) {
+    std::string_view current{};
+    if (!next(current))
+        return false;
+    line.assign(current);
+    return true;
+}
+
+bool line_reader::next(std::string_view& line) {
+    if (m_done)
+        return false;
+    size_t end = m_rest.find('\n');
+    std::string_view current = m_rest.substr(0, end);
+    if (end == std::string_view::npos) {
+        m_rest = {};
+        m_done = true;
+    } else {
+        m_rest.remove_prefix(end + 1);
+        // like getline, there's no empty line after the last newline
+        m_done = m_rest.empty();
+    }
+    if (current.ends_with('\r'))
+        current.remove_suffix(1);
+    line = current;
+    return true;
+}
+
+void file_writer::write(const void* data, size_t size) {
+    m_buffer.append(static_cast<const char*>(data), size);
+}
+
+bool file_writer::write_temp() const {
+    io_timer timer{};
+    const std::string temp = temp_path();
+    FILE* file = fopen(temp.c_str(), m_text ? "w" : "wb");
     if (!file) {
-        iohandler::get_global().error("Could not open \"%s\": %s\n", name, strerror(errno));
-        return nullptr;
+        iohandler::get_global().error("Could not open \"%s\": %s\n", temp.c_str(), strerror(errno));
+        return false;
+    }
+    bool ok = fwrite(m_buffer.data(), 1, m_buffer.size(), file) == m_buffer.size();
+    ok = fclose(file) == 0 && ok;
+    if (!ok) {
+        iohandler::get_global().error("Could not write \"%s\": %s\n", temp.c_str(), strerror(errno));
+        std::error_code ec{};
+        fs::remove(temp, ec);
+        return false;
+    }
+    return true;
+}
+
+bool file_writer::replace_from_temp() const {
+    io_timer timer{};
+    const std::string temp = temp_path();
+    std::error_code ec{};
+    fs::rename(temp, m_path, ec);
+    if (ec) {
+        iohandler::get_global().error("Could not replace \"%s\": %s\n", m_path.c_str(), ec.message().c_str());
+        fs::remove(temp, ec);
+        return false;
+    }
+    g_io_stats.bytes_written += m_buffer.size();
+    g_io_stats.files_written++;
+    return true;
+}
+
+bool file_writer::commit() {
+    return write_temp() && replace_from_temp();
+}
+
+void output_transaction::remove_temps() const {
+    for (const file_writer& file : m_files) {
+        std::error_code ec{};
+        fs::remove(file.temp_path(), ec);
     }
-    return file;
 }
 
-size_t file_size(FILE *file) {
-    long off = ftell(file);
-    fseek(file, 0, SEEK_END);
-    size_t size = ftell(file);
-    fseek(file, off, SEEK_SET);
-    return size;
+// moved is false if there's no destination yet, there's nothing to put back then
+bool file_writer::move_to_backup(bool& moved) const {
+    std::error_code ec{};
+    moved = false;
+    if (!fs::exists(m_path, ec))
+        return true;
+    const std::string backup = backup_path();
+    fs::rename(m_path, backup, ec);
+    if (ec) {
+        iohandler::get_global().error("Could not move \"%s\" to \"%s\": %s\n", m_path.c_str(), backup.c_str(),
+                                      ec.message().c_str());
+        return false;
+    }
+    moved = true;
+    return true;
 }
 
-unsigned char *read_all(const char *file_name, bool text_mode, unsigned int minimum_size) {
-    FILE *file = open(file_name, "rb");
-    if (file == nullptr) {
-        return nullptr;
+// leaves the destination as it was before move_to_backup, whether or not it was replaced since
+void file_writer::restore_backup(bool moved) const {
+    std::error_code ec{};
+    if (!moved) {
+        fs::remove(m_path, ec);
+        return;
+    }
+    const std::string backup = backup_path();
+    fs::rename(backup, m_path, ec);
+    if (ec)
+        iohandler::get_global().error("Could not restore \"%s\" from \"%s\": %s\n", m_path.c_str(), backup.c_str(),
+                                      ec.message().c_str());
+}
+
+bool output_transaction::commit() {
+    for (const file_writer& file : m_files) {
+        if (!file.write_temp()) {
+            remove_temps();
+            return false;
+        }
+    }
+    // files [0, backed_up) have been moved out of the way (or had no destination), these are the ones to restore
+    std::vector<bool> moved(m_files.size(), false);
+    size_t backed_up = 0;
+    bool ok = true;
+    for (; backed_up < m_files.size(); backed_up++) {
+        bool file_moved = false;
+        if (!m_files[backed_up].move_to_backup(file_moved)) {
+            ok = false;
+            break;
+        }
+        moved[backed_up] = file_moved;
     }
-    size_t size = file_size(file);
-    unsigned char *file_data = new unsigned char[(size < minimum_size ? minimum_size : size) + (text_mode * 2)];
-    if (fread(file_data, 1, size, file) != size) {
-        iohandler::get_global().error("%s could not be fully read.  Please check file permissions.", file_name);
-        delete[] file_data;
-        return nullptr;
+    for (size_t i = 0; ok && i < m_files.size(); i++)
+        ok = m_files[i].replace_from_temp();
+    for (size_t i = 0; i < backed_up; i++) {
+        if (!ok) {
+            m_files[i].restore_backup(moved[i]);
+        } else if (moved[i]) {
+            std::error_code ec{};
+            fs::remove(m_files[i].backup_path(), ec);
+        }
     }
-    fclose(file);
-    return file_data;
+    if (!ok)
+        remove_temps();
+    m_files.clear();
+    return ok;
 }
 
 patchfile write_all(unsigned char* data, std::string_view file_name, unsigned int size) {
@@ -1,16 +1,163 @@
 #ifndef FILES_IO_H
 #define FILES_IO_H
 
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <deque>
+#include <span>
+#include <string>
 #include <string_view>
+#include <vector>
 #include "structs.h"
 
-FILE *open(const char *name, const char *mode);
-size_t file_size(FILE *file);
-[[nodiscard]] unsigned char *read_all(const char *file_name, bool text_mode = false, unsigned int minimum_size = 0u);
+// totals of every file_buffer::open and file_writer::commit since the last reset_io_stats()
+struct io_stats {
+    uint64_t bytes_read;
+    uint64_t bytes_written;
+    uint64_t files_read;
+    uint64_t files_written;
+    uint64_t nanoseconds; // time spent opening, reading and writing files
+};
+[[nodiscard]] io_stats get_io_stats();
+void reset_io_stats();
+
+/**
+    Read-only contents of a whole file.
+    Files of at least MMAP_THRESHOLD bytes are memory mapped, smaller ones are read into a buffer
+    that is borrowed from a pool and given back when the file_buffer is destroyed.
+*/
+class file_buffer {
+    const unsigned char* m_data = nullptr;
+    size_t m_size = 0;
+    std::vector<unsigned char> m_storage{};
+    void* m_mapping = nullptr;
+#ifdef ON_WINDOWS
+    void* m_mapping_handle = nullptr;
+#endif
+
+    void release();
+
+  public:
+    static constexpr size_t MMAP_THRESHOLD = 256 * 1024;
+
+    file_buffer() = default;
+    file_buffer(file_buffer&& other) noexcept;
+    file_buffer& operator=(file_buffer&& other) noexcept;
+    file_buffer(const file_buffer&) = delete;
+    file_buffer& operator=(const file_buffer&) = delete;
+    ~file_buffer();
+
+    /**
+        @param path is the file to read
+        @param report_errors is whether a missing or unreadable file is reported through iohandler
+        @return false if the file couldn't be read, errno is left as set by the failing call
+    */
+    [[nodiscard]] bool open(const std::string& path, bool report_errors = true);
+
+    [[nodiscard]] const unsigned char* data() const {
+        return m_data;
+    }
+    [[nodiscard]] size_t size() const {
+        return m_size;
+    }
+    [[nodiscard]] std::span<const unsigned char> bytes() const {
+        return {m_data, m_size};
+    }
+    [[nodiscard]] std::string_view view() const {
+        return {reinterpret_cast<const char*>(m_data), m_size};
+    }
+};
+
+// splits a text file in lines the same way std::getline does on a file opened in text mode
+class line_reader {
+    std::string_view m_rest;
+    bool m_done;
+
+  public:
+    explicit line_reader(std::string_view text) : m_rest{text}, m_done{text.empty()} {
+    }
+    [[nodiscard]] bool next(std::string& line);
+    // same as above but the line points into the text instead of being copied
+    [[nodiscard]] bool next(std::string_view& line);
+};
+
+/**
+    Buffers everything written to it and only touches the disk in commit(), where the data is written to
+    a temporary file next to the destination which is then renamed over it, so the destination is either
+    left untouched or fully replaced. Nothing is written if commit() isn't called.
+*/
+class file_writer {
+    std::string m_path;
+    std::string m_buffer{};
+    bool m_text;
+
+    friend class output_transaction;
+    [[nodiscard]] std::string temp_path() const {
+        return m_path + ".tmp";
+    }
+    [[nodiscard]] std::string backup_path() const {
+        return m_path + ".bak.tmp";
+    }
+    [[nodiscard]] bool write_temp() const;
+    [[nodiscard]] bool replace_from_temp() const;
+    [[nodiscard]] bool move_to_backup(bool& moved) const;
+    void restore_backup(bool moved) const;
+
+  public:
+    /**
+        @param path is the destination file
+        @param text is whether newlines get translated like a file opened with "w" instead of "wb"
+    */
+    explicit file_writer(std::string path, bool text = false) : m_path{std::move(path)}, m_text{text} {
+    }
+
+    void write(const void* data, size_t size);
+    void write(std::string_view str) {
+        m_buffer.append(str);
+    }
+    void put(char c) {
+        m_buffer.push_back(c);
+    }
+    template <typename... Args> void printf(format_string<Args...> format, const Args&... args) {
+        format_to(m_buffer, format, args...);
+    }
+
+    [[nodiscard]] const std::string& path() const {
+        return m_path;
+    }
+    [[nodiscard]] size_t size() const {
+        return m_buffer.size();
+    }
+
+    [[nodiscard]] bool commit();
+};
+
+/**
+    Files that are committed together: commit() first writes every one of them to its temporary file and only
+    once all of those have been written renames them over their destinations. If writing any of them fails
+    the temporary files are removed and no destination is touched, nothing is written if commit() isn't called.
+    The destinations that exist are moved to a backup before the renames, if one of the renames fails the backups
+    are put back so every destination is left as it was, they're deleted once all of the renames succeeded.
+*/
+class output_transaction {
+    std::deque<file_writer> m_files{}; // deque so that the references returned by add() stay valid
+
+    void remove_temps() const;
+
+  public:
+    // the returned writer belongs to the transaction and lives as long as it does
+    file_writer& add(std::string path, bool text = false) {
+        return m_files.emplace_back(std::move(path), text);
+    }
+    [[nodiscard]] size_t size() const {
+        return m_files.size();
+    }
+    [[nodiscard]] bool commit();
+};
+
 [[nodiscard]] patchfile write_all(unsigned char *data, std::string_view file_name, unsigned int size);
 [[nodiscard]] patchfile write_all(unsigned char* data, std::string_view dir, std::string_view file_name,
                                   unsigned int size);
 
-#endif
\ No newline at end of file
+#endif
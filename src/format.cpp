@@ -0,0 +1,234 @@
+#include "format.h"
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+
+namespace formatting {
+
+namespace {
+
+constexpr char lower_digits[] = "0123456789abcdef";
+constexpr char upper_digits[] = "0123456789ABCDEF";
+
+void pad(std::string& out, int count, char c) {
+    if (count > 0)
+        out.append(static_cast<size_t>(count), c);
+}
+
+// writes text with the spaces needed to reach the field width
+void write_field(std::string& out, const spec& s, std::string_view text) {
+    int padding = s.width - static_cast<int>(text.size());
+    if (!s.left)
+        pad(out, padding, ' ');
+    out.append(text);
+    if (s.left)
+        pad(out, padding, ' ');
+}
+
+uint64_t truncate(uint64_t value, int bits) {
+    return bits >= 64 ? value : value & ((uint64_t{1} << bits) - 1);
+}
+
+int64_t sign_extend(uint64_t value, int bits) {
+    if (bits >= 64)
+        return static_cast<int64_t>(value);
+    const uint64_t sign = uint64_t{1} << (bits - 1);
+    value = truncate(value, bits);
+    return static_cast<int64_t>((value ^ sign) - sign);
+}
+
+void write_integer(std::string& out, const spec& s, uint64_t raw) {
+    char sign = '\0';
+    uint64_t magnitude = 0;
+    if (s.conversion == 'd' || s.conversion == 'i') {
+        int64_t value = sign_extend(raw, s.length_bits);
+        magnitude = value < 0 ? uint64_t{0} - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+        if (value < 0)
+            sign = '-';
+        else if (s.plus)
+            sign = '+';
+        else if (s.space)
+            sign = ' ';
+    } else {
+        magnitude = truncate(raw, s.length_bits);
+    }
+
+    // digits are produced at the end of a scratch buffer, 22 is enough for 64 bits in octal
+    char digits[24];
+    char* const end = digits + sizeof(digits);
+    char* begin = end;
+    if (s.conversion == 'x' || s.conversion == 'X') {
+        const char* table = s.conversion == 'X' ? upper_digits : lower_digits;
+        do {
+            *--begin = table[magnitude & 0xF];
+            magnitude >>= 4;
+        } while (magnitude != 0);
+    } else {
+        const int base = s.conversion == 'o' ? 8 : 10;
+        auto result = std::to_chars(digits, end, magnitude, base);
+        size_t count = static_cast<size_t>(result.ptr - digits);
+        begin = end - count;
+        std::memmove(begin, digits, count);
+    }
+    int digit_count = static_cast<int>(end - begin);
+    // printf writes nothing for a 0 with an explicit precision of 0
+    if (s.precision == 0 && digit_count == 1 && *begin == '0')
+        digit_count = 0;
+
+    std::string_view prefix{};
+    if (s.alternate && truncate(raw, s.length_bits) != 0) {
+        if (s.conversion == 'x')
+            prefix = "0x";
+        else if (s.conversion == 'X')
+            prefix = "0X";
+    }
+    if (s.alternate && s.conversion == 'o' && s.precision <= digit_count)
+        prefix = "0";
+
+    const int precision_zeros = s.precision > digit_count ? s.precision - digit_count : 0;
+    const int length = (sign ? 1 : 0) + static_cast<int>(prefix.size()) + precision_zeros + digit_count;
+    const int padding = s.width > length ? s.width - length : 0;
+    const bool zero_pad = s.zero && !s.left && s.precision < 0;
+
+    out.reserve(out.size() + static_cast<size_t>(length + padding));
+    if (!s.left && !zero_pad)
+        pad(out, padding, ' ');
+    if (sign)
+        out.push_back(sign);
+    out.append(prefix);
+    if (zero_pad)
+        pad(out, padding, '0');
+    pad(out, precision_zeros, '0');
+    out.append(end - digit_count, static_cast<size_t>(digit_count));
+    if (s.left)
+        pad(out, padding, ' ');
+}
+
+void write_floating(std::string& out, const spec& s, double value) {
+    // rare enough (debug timings) that the C library does the work, rebuilding the conversion from the spec
+    char format[16];
+    char* f = format;
+    *f++ = '%';
+    if (s.left)
+        *f++ = '-';
+    if (s.plus)
+        *f++ = '+';
+    if (s.space)
+        *f++ = ' ';
+    if (s.alternate)
+        *f++ = '#';
+    if (s.zero)
+        *f++ = '0';
+    *f++ = '*';
+    *f++ = '.';
+    *f++ = '*';
+    *f++ = s.conversion;
+    *f = '\0';
+    const int width = s.width < 0 ? 0 : s.width;
+    const int precision = s.precision < 0 ? 6 : s.precision;
+    char buffer[64];
+    int needed = std::snprintf(buffer, sizeof(buffer), format, width, precision, value);
+    if (needed < 0)
+        return;
+    if (static_cast<size_t>(needed) < sizeof(buffer)) {
+        out.append(buffer, static_cast<size_t>(needed));
+    } else {
+        size_t offset = out.size();
+        out.resize(offset + static_cast<size_t>(needed) + 1);
+        std::snprintf(out.data() + offset, static_cast<size_t>(needed) + 1, format, width, precision, value);
+        out.pop_back();
+    }
+}
+
+void append_utf8(std::string& out, const wchar_t* str, int precision) {
+    std::string converted{};
+    for (; str && *str; str++) {
+        uint32_t cp = static_cast<uint32_t>(*str);
+        if constexpr (sizeof(wchar_t) == 2) {
+            if (cp >= 0xD800 && cp < 0xDC00 && str[1] >= 0xDC00 && str[1] < 0xE000) {
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (static_cast<uint32_t>(str[1]) - 0xDC00);
+                str++;
+            }
+        }
+        if (cp < 0x80) {
+            converted.push_back(static_cast<char>(cp));
+        } else if (cp < 0x800) {
+            converted.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+            converted.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        } else if (cp < 0x10000) {
+            converted.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+            converted.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+            converted.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        } else {
+            converted.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+            converted.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+            converted.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+            converted.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        }
+    }
+    if (precision >= 0 && converted.size() > static_cast<size_t>(precision))
+        converted.resize(static_cast<size_t>(precision));
+    out.append(converted);
+}
+
+} // namespace
+
+void vformat_to(std::string& out, const char* format, const format_arg* args) {
+    const std::string_view fmt{format};
+    size_t literal_start = 0;
+    for (size_t pos = 0; pos < fmt.size(); pos++) {
+        if (fmt[pos] != '%')
+            continue;
+        out.append(fmt.substr(literal_start, pos - literal_start));
+        spec s = parse_spec(fmt, pos);
+        literal_start = std::min(pos + 1, fmt.size());
+        if (s.conversion == '%') {
+            out.push_back('%');
+            continue;
+        }
+        const format_arg& arg = *args++;
+        switch (s.conversion) {
+        case 'c': {
+            const char c = static_cast<char>(arg.integer);
+            write_field(out, s, std::string_view{&c, 1});
+            break;
+        }
+        case 's':
+        case 'S':
+            if (arg.kind == arg_kind::wide_string) {
+                std::string converted{};
+                append_utf8(converted, arg.wide_string, s.precision);
+                write_field(out, s, converted);
+            } else {
+                std::string_view str{arg.string ? arg.string : "(null)", arg.string ? arg.string_size : 6};
+                if (s.precision >= 0 && str.size() > static_cast<size_t>(s.precision))
+                    str = str.substr(0, static_cast<size_t>(s.precision));
+                write_field(out, s, str);
+            }
+            break;
+        case 'p': {
+            spec hex = s;
+            hex.conversion = 'x';
+            hex.alternate = true;
+            hex.length_bits = 64;
+            write_integer(out, hex, reinterpret_cast<uintptr_t>(arg.pointer));
+            break;
+        }
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+            write_floating(out, s, arg.floating);
+            break;
+        default:
+            write_integer(out, s, arg.integer);
+            break;
+        }
+    }
+    out.append(fmt.substr(literal_start));
+}
+
+} // namespace formatting
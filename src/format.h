@@ -0,0 +1,237 @@
+#ifndef FORMAT_H
+#define FORMAT_H
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+/*
+    printf-style formatting that appends to a std::string in a single pass.
+    Format strings are checked at compile time against the arguments, the supported subset is
+        %[flags][width][.precision][length]conversion
+    with flags -+ #0, length hh h l ll z j t L and conversions d i u x X o c s S f F e E g G p %.
+    Integers are written with std::to_chars (hex through a lookup table), %s also takes std::string and
+    std::string_view directly, %S (or %ls) takes a wide string that is written as UTF-8.
+*/
+namespace formatting {
+
+enum class arg_kind : unsigned char { none, integer, floating, string, wide_string, pointer };
+
+template <typename T> consteval arg_kind kind_of() {
+    using U = std::remove_cvref_t<T>;
+    if constexpr (std::is_integral_v<U> || std::is_enum_v<U>)
+        return arg_kind::integer;
+    else if constexpr (std::is_floating_point_v<U>)
+        return arg_kind::floating;
+    else if constexpr (std::is_convertible_v<U, std::string_view>)
+        return arg_kind::string;
+    else if constexpr (std::is_convertible_v<U, const wchar_t*>)
+        return arg_kind::wide_string;
+    else if constexpr (std::is_pointer_v<std::decay_t<U>>)
+        return arg_kind::pointer;
+    else
+        static_assert(!sizeof(U), "type can't be formatted");
+}
+
+// deliberately not constexpr, calling it while checking a format string makes the compilation fail
+inline void format_error(const char*) {
+}
+
+struct spec {
+    bool left = false;
+    bool plus = false;
+    bool space = false;
+    bool alternate = false;
+    bool zero = false;
+    int width = -1;
+    int precision = -1;
+    int length_bits = 32; // width of the integer argument implied by the length modifier
+    bool wide = false;    // %ls
+    char conversion = '\0';
+};
+
+// parses the conversion starting at format[pos] == '%', pos is left on the conversion character
+constexpr spec parse_spec(std::string_view format, size_t& pos) {
+    spec s{};
+    auto at = [&](size_t i) { return i < format.size() ? format[i] : '\0'; };
+    pos++;
+    for (;; pos++) {
+        char c = at(pos);
+        if (c == '-')
+            s.left = true;
+        else if (c == '+')
+            s.plus = true;
+        else if (c == ' ')
+            s.space = true;
+        else if (c == '#')
+            s.alternate = true;
+        else if (c == '0')
+            s.zero = true;
+        else
+            break;
+    }
+    if (at(pos) >= '1' && at(pos) <= '9') {
+        s.width = 0;
+        while (at(pos) >= '0' && at(pos) <= '9')
+            s.width = s.width * 10 + (at(pos++) - '0');
+    }
+    if (at(pos) == '.') {
+        pos++;
+        s.precision = 0;
+        while (at(pos) >= '0' && at(pos) <= '9')
+            s.precision = s.precision * 10 + (at(pos++) - '0');
+    }
+    switch (at(pos)) {
+    case 'h':
+        s.length_bits = at(pos + 1) == 'h' ? 8 : 16;
+        pos += at(pos + 1) == 'h' ? 2 : 1;
+        break;
+    case 'l':
+        if (at(pos + 1) == 'l') {
+            s.length_bits = 64;
+            pos += 2;
+        } else {
+            s.length_bits = sizeof(long) * 8;
+            s.wide = true;
+            pos++;
+        }
+        break;
+    case 'j':
+        s.length_bits = 64;
+        pos++;
+        break;
+    case 'z':
+    case 't':
+        s.length_bits = sizeof(size_t) * 8;
+        pos++;
+        break;
+    case 'L':
+        pos++;
+        break;
+    default:
+        break;
+    }
+    s.conversion = at(pos);
+    return s;
+}
+
+constexpr bool accepts(const spec& s, arg_kind kind) {
+    switch (s.conversion) {
+    case 'd':
+    case 'i':
+    case 'u':
+    case 'x':
+    case 'X':
+    case 'o':
+    case 'c':
+        return kind == arg_kind::integer;
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+        return kind == arg_kind::floating;
+    case 's':
+        return kind == (s.wide ? arg_kind::wide_string : arg_kind::string);
+    case 'S':
+        return kind == arg_kind::wide_string;
+    case 'p':
+        return kind == arg_kind::pointer || kind == arg_kind::string || kind == arg_kind::wide_string;
+    default:
+        return false;
+    }
+}
+
+template <typename... Args> consteval void check_format(std::string_view format) {
+    constexpr arg_kind kinds[]{kind_of<Args>()..., arg_kind::none};
+    size_t arg = 0;
+    for (size_t pos = 0; pos < format.size(); pos++) {
+        if (format[pos] != '%')
+            continue;
+        spec s = parse_spec(format, pos);
+        if (s.conversion == '%')
+            continue;
+        if (arg >= sizeof...(Args))
+            format_error("not enough arguments for the format string");
+        else if (!accepts(s, kinds[arg]))
+            format_error("argument type doesn't match its conversion");
+        arg++;
+    }
+    if (arg != sizeof...(Args))
+        format_error("too many arguments for the format string");
+}
+
+template <typename... Args> struct format_string {
+    const char* str;
+    template <typename S>
+        requires std::convertible_to<const S&, const char*>
+    consteval format_string(const S& s) : str{s} {
+        check_format<Args...>(str);
+    }
+};
+
+// type erased argument, integers keep their bits sign extended to 64 bits
+struct format_arg {
+    arg_kind kind = arg_kind::none;
+    union {
+        uint64_t integer;
+        double floating;
+        const void* pointer;
+    };
+    const char* string = nullptr;
+    size_t string_size = 0;
+    const wchar_t* wide_string = nullptr;
+
+    format_arg() : integer{0} {
+    }
+    template <typename T>
+        requires(std::is_integral_v<T> || std::is_enum_v<T>)
+    format_arg(T value) : kind{arg_kind::integer} {
+        if constexpr (std::is_enum_v<T>)
+            integer = static_cast<uint64_t>(static_cast<int64_t>(static_cast<std::underlying_type_t<T>>(value)));
+        else if constexpr (std::is_signed_v<T>)
+            integer = static_cast<uint64_t>(static_cast<int64_t>(value));
+        else
+            integer = static_cast<uint64_t>(value);
+    }
+    template <std::floating_point T> format_arg(T value) : kind{arg_kind::floating}, floating{value} {
+    }
+    format_arg(std::string_view value) : kind{arg_kind::string}, pointer{value.data()} {
+        string = value.data();
+        string_size = value.size();
+    }
+    format_arg(const char* value) : kind{arg_kind::string}, pointer{value} {
+        string = value;
+        string_size = value ? std::char_traits<char>::length(value) : 0;
+    }
+    format_arg(const std::string& value) : format_arg{std::string_view{value}} {
+    }
+    format_arg(const wchar_t* value) : kind{arg_kind::wide_string}, pointer{value} {
+        wide_string = value;
+    }
+    format_arg(const void* value) : kind{arg_kind::pointer}, pointer{value} {
+    }
+};
+
+void vformat_to(std::string& out, const char* format, const format_arg* args);
+
+} // namespace formatting
+
+template <typename... Args> using format_string = formatting::format_string<std::type_identity_t<Args>...>;
+
+// appends the formatted text to out
+template <typename... Args> void format_to(std::string& out, format_string<Args...> format, const Args&... args) {
+    const formatting::format_arg arg_list[]{formatting::format_arg{args}..., formatting::format_arg{}};
+    formatting::vformat_to(out, format.str, arg_list);
+}
+
+template <typename... Args> std::string fstring(format_string<Args...> format, const Args&... args) {
+    std::string buffer{};
+    format_to(buffer, format, args...);
+    return buffer;
+}
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef HASHING_H
+#define HASHING_H
+#include <cstddef>
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+// 64-bit FNV-1a, used to tell whether the inputs of a patch changed since the last run. Not cryptographic.
+class fnv1a_hash {
+    uint64_t m_state = 0xCBF29CE484222325;
+
+  public:
+    void update(const void* data, size_t size) {
+        auto bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; i++) {
+            m_state ^= bytes[i];
+            m_state *= 0x100000001B3;
+        }
+    }
+    // strings are hashed with their length so that consecutive strings can't be confused with each other
+    void update(std::string_view text) {
+        update_value(text.size());
+        update(text.data(), text.size());
+    }
+    template <typename T> void update_value(T value) {
+        update(&value, sizeof(value));
+    }
+    uint64_t value() const {
+        return m_state;
+    }
+};
+
+// CRC-32 (ISO-HDLC, the one zip and the BPS patch format use)
+class crc32_hash {
+    static constexpr std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> t{};
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+    uint32_t m_state = 0xFFFFFFFF;
+
+  public:
+    void update(const void* data, size_t size) {
+        auto bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; i++)
+            m_state = table[(m_state ^ bytes[i]) & 0xFF] ^ (m_state >> 8);
+    }
+    uint32_t value() const {
+        return m_state ^ 0xFFFFFFFF;
+    }
+};
+
+#endif
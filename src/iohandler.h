@@ -1,25 +1,16 @@
 #pragma once
 
+#include "format.h"
 #include "libconsole/libconsole.h"
 #include <cstdarg>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <mutex>
 #include <string>
+#include <string_view>
 #include <vector>
 
-#ifndef _SAL_VERSION
-#define _In_z_ 
-#define _Printf_format_string_
-#endif
-
-template <typename... Args> std::string fstring(const char* format, Args&&... args) {
-    int needed = snprintf(nullptr, 0, format, args...);
-    std::string buffer{};
-    buffer.resize(needed);
-    snprintf(buffer.data(), needed + 1, format, args...);
-    return buffer;
-}
 
 class iohandler {
 
@@ -31,29 +22,29 @@ class iohandler {
     bool m_debug_enabled{};
     std::string m_last_error;
     std::vector<const char*> m_output_lines;
+    // messages can come from the task_graph workers as well as from the main thread
+    std::mutex m_mutex;
 
     void set(iotype tp, FILE* newhandle);
 
-    template <typename... Args> void append_to_output(const char* format, Args... args) {
-        int needed = snprintf(nullptr, 0, format, args...);
-        char* buffer = new char[needed + 1];
-        snprintf(buffer, needed + 1, format, args...);
-        m_output_lines.push_back(buffer);
-    }
-
-    void append_to_output(const char* message) {
-        char* buffer = new char[strlen(message) + 1];
-        strcpy(buffer, message);
+    void append_to_output(std::string_view message) {
+        char* buffer = new char[message.size() + 1];
+        memcpy(buffer, message.data(), message.size());
+        buffer[message.size()] = '\0';
         m_output_lines.push_back(buffer);
     }
 
-    template <typename... Args> void print_generic([[maybe_unused]] iotype tp, const char* message, Args... args) {
-        append_to_output(message, args...);
+    // message is already formatted, it's written as is
+    void print_generic([[maybe_unused]] iotype tp, const std::string& message, bool is_error = false) {
+        std::lock_guard lock{m_mutex};
+        if (is_error)
+            m_last_error += message;
+        append_to_output(message);
 #ifdef PIXI_EXE_BUILD
         if (m_replaced[tp]) {
-            con::cfprintf(m_handles[tp], message, args...);
+            con::cfprintf(m_handles[tp], "%s", message.c_str());
         } else {
-            con::cprintf(message, args...);
+            con::cprintf("%s", message.c_str());
         }
 #endif
     }
@@ -91,27 +82,25 @@ class iohandler {
     }
     void error(const char* message) {
         // prints to stdout for backwards compatibility
-        m_last_error += message;
-        print_generic(out, message);
+        print_generic(out, message, true);
     }
-    template <typename... Args> void error(_In_z_ _Printf_format_string_ const char* message, Args... args) {
+    template <typename... Args> void error(format_string<Args...> message, const Args&... args) {
         // prints to stdout for backwards compatibility
-        m_last_error += fstring(message, args...);
-        print_generic(out, message, args...);
+        print_generic(out, fstring(message, args...), true);
     }
     void print(const char* message) {
         print_generic(out, message);
     }
-    template <typename... Args> void print(_In_z_ _Printf_format_string_ const char* message, Args... args) {
-        print_generic(out, message, args...);
+    template <typename... Args> void print(format_string<Args...> message, const Args&... args) {
+        print_generic(out, fstring(message, args...));
     }
     void debug(const char* message) {
         if (m_debug_enabled)
             print_generic(debug_, message);
     }
-    template <typename... Args> void debug(_In_z_ _Printf_format_string_ const char* message, Args... args) {
+    template <typename... Args> void debug(format_string<Args...> message, const Args&... args) {
         if (m_debug_enabled) {
-            print_generic(debug_, message, args...);
+            print_generic(debug_, fstring(message, args...));
         }
     }
     int scanf(const char* fmt, ...);
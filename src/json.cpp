@@ -7,7 +7,6 @@
 #include "json/base64.h"
 #include <algorithm>
 #include <cstring>
-#include <fstream>
 #include <nlohmann/json.hpp>
 #include <filesystem>
 
@@ -17,13 +16,13 @@ bool read_json_file(sprite* spr) {
     iohandler& io = iohandler::get_global();
     json j;
     try {
-        std::ifstream instr(spr->cfg_file);
-        if (!instr) {
+        file_buffer contents{};
+        if (!contents.open(spr->cfg_file, false)) {
             io.error("JSON file \"%s\" wasn't found, make sure to have the correct filenames in your list file\n",
                      spr->cfg_file.c_str());
             return false;
         }
-        instr >> j;
+        j = json::parse(contents.view());
     } catch (const json::parse_error& err) {
         // https://json.nlohmann.me/api/basic_json/operator_gtgt/#exceptions
         switch (err.id) {
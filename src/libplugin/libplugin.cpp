@@ -28,6 +28,15 @@ int plugin::load() {
         m_after_patching = reinterpret_cast<pluginEntryPoint>(LoadEntryPoint(m_lib_handle, "pixi_after_patching"));
         m_check_version = reinterpret_cast<pluginEntryPoint>(LoadEntryPoint(m_lib_handle, "pixi_check_version"));
         m_before_unload = reinterpret_cast<pluginEntryPoint>(LoadEntryPoint(m_lib_handle, "pixi_before_unload"));
+        m_after_list_parse =
+            reinterpret_cast<pluginContextEntryPoint>(LoadEntryPoint(m_lib_handle, "pixi_after_list_parse"));
+        m_before_sprite_patching =
+            reinterpret_cast<pluginContextEntryPoint>(LoadEntryPoint(m_lib_handle, "pixi_before_sprite_patching"));
+        m_before_core_patches =
+            reinterpret_cast<pluginContextEntryPoint>(LoadEntryPoint(m_lib_handle, "pixi_before_core_patches"));
+        m_after_rom_patching =
+            reinterpret_cast<pluginContextEntryPoint>(LoadEntryPoint(m_lib_handle, "pixi_after_rom_patching"));
+        m_after_meimei = reinterpret_cast<pluginContextEntryPoint>(LoadEntryPoint(m_lib_handle, "pixi_after_meimei"));
         m_plugin_error = reinterpret_cast<pluginErrorInfo>(LoadEntryPoint(m_lib_handle, "pixi_plugin_error"));
     } else {
         return EXIT_FAILURE;
@@ -61,6 +70,36 @@ int plugin::after_patching() const {
     }
     return 0;
 }
+int plugin::after_list_parse(pixi_plugin_context* context) const {
+    if (m_after_list_parse != NULL) {
+        return plugin_check_return(m_after_list_parse(context), "pixi_after_list_parse()");
+    }
+    return 0;
+}
+int plugin::before_sprite_patching(pixi_plugin_context* context) const {
+    if (m_before_sprite_patching != NULL) {
+        return plugin_check_return(m_before_sprite_patching(context), "pixi_before_sprite_patching()");
+    }
+    return 0;
+}
+int plugin::before_core_patches(pixi_plugin_context* context) const {
+    if (m_before_core_patches != NULL) {
+        return plugin_check_return(m_before_core_patches(context), "pixi_before_core_patches()");
+    }
+    return 0;
+}
+int plugin::after_rom_patching(pixi_plugin_context* context) const {
+    if (m_after_rom_patching != NULL) {
+        return plugin_check_return(m_after_rom_patching(context), "pixi_after_rom_patching()");
+    }
+    return 0;
+}
+int plugin::after_meimei(pixi_plugin_context* context) const {
+    if (m_after_meimei != NULL) {
+        return plugin_check_return(m_after_meimei(context), "pixi_after_meimei()");
+    }
+    return 0;
+}
 int plugin::check_version(int expected_version) const {
     if (m_check_version != NULL) {
         int required_ver = m_check_version();
@@ -4,17 +4,30 @@
 #include <string>
 #include <string_view>
 #include <vector>
+#include "pixi_plugin.h"
 
 /*
  * PIXI PLUGIN DOCUMENTATION:
- * - Supports 4 hooks:
+ * - Supports these hooks:
  *   - int pixi_before_patching(void) -> occurs before any modifications to the rom, always runs
- *   - int pixi_after_patching(void) -> occurs after all modifications to the rom, will only run if there are no errors
+ *   - int pixi_after_patching(void) -> occurs after all modifications to the rom have been written to disk, will only
+ *     run if there are no errors
+ *   - int pixi_after_list_parse(pixi_plugin_context*) -> occurs once list.txt and the sprite cfg/json files have been
+ *     parsed and the rom has been loaded, before anything is inserted
+ *   - int pixi_before_sprite_patching(pixi_plugin_context*) -> occurs right before the sprites are inserted
+ *   - int pixi_before_core_patches(pixi_plugin_context*) -> occurs after the sprites have been inserted, right before
+ *     main.asm, the misc sprite hijacks and ExtraHijacks are applied
+ *   - int pixi_after_rom_patching(pixi_plugin_context*) -> occurs once all the patches have been applied to the
+ *     in-memory rom, before MeiMei runs
+ *   - int pixi_after_meimei(pixi_plugin_context*) -> occurs after MeiMei has run (or would have), right before the rom
+ *     and the .ssc/.mwt/.mw2/.s16/.extmod files are written to disk together, a failure here leaves them untouched
+ *   The context (see pixi_plugin.h) exposes the rom buffer and the parsed sprite lists, and lets the hooks add
+ *   in-memory files and defines that every patch applied afterwards can use.
  *   - int pixi_check_version(void) -> returns an int that defines what version of pixi this plugin is targeting
  *   - int pixi_before_unload(void) -> occurs at plugin unloading, always runs
  *   - const char* pixi_plugin_error(void) -> used to retrieve error info in case a hook returns a non-zero exit code.
  * - All hooks are optional and may or may not be defined, as such, a plugin with no hooks is valid (but useless)
- * - All hooks are expected to take no arguments and return an integer,
+ * - All hooks are expected to take no arguments (or a pixi_plugin_context* where noted) and return an integer,
  *   except for pixi_plugin_error which is expected to return a null terminated const char*
  *   the returned int is used as exit code in all cases except for pixi_check_version which uses it as version number
  *   an exit code of 0 is assumed to be success, everything else is failure
@@ -40,6 +53,7 @@ namespace plugins {
 extern "C" {
 typedef int (*pluginEntryPoint)(void);
 typedef const char* (*pluginErrorInfo)(void);
+typedef pixi_plugin_context_hook pluginContextEntryPoint;
 }
 #define PLUGIN_ENTRY_POINT(name, ...)                                                                                  \
   private:                                                                                                             \
@@ -48,6 +62,13 @@ typedef const char* (*pluginErrorInfo)(void);
   public:                                                                                                              \
     int name(__VA_ARGS__) const;
 
+#define PLUGIN_CONTEXT_ENTRY_POINT(name)                                                                               \
+  private:                                                                                                             \
+    pluginContextEntryPoint m_##name = NULL;                                                                           \
+                                                                                                                       \
+  public:                                                                                                              \
+    int name(pixi_plugin_context* context) const;
+
 class plugin {
 #ifdef UNICODE
     using path_type = std::wstring;
@@ -66,6 +87,11 @@ class plugin {
     PLUGIN_ENTRY_POINT(after_patching)
     PLUGIN_ENTRY_POINT(check_version, int)
     PLUGIN_ENTRY_POINT(before_unload)
+    PLUGIN_CONTEXT_ENTRY_POINT(after_list_parse)
+    PLUGIN_CONTEXT_ENTRY_POINT(before_sprite_patching)
+    PLUGIN_CONTEXT_ENTRY_POINT(before_core_patches)
+    PLUGIN_CONTEXT_ENTRY_POINT(after_rom_patching)
+    PLUGIN_CONTEXT_ENTRY_POINT(after_meimei)
     ~plugin();
 };
 
@@ -0,0 +1,105 @@
+#ifndef PIXI_PLUGIN_H
+#define PIXI_PLUGIN_H
+/*
+ * C ABI of the context passed to the plugin hooks that take one, see libplugin.h for the list of hooks.
+ * This header is meant to be copied into plugins.
+ *
+ * - abi_version is bumped every time a field changes meaning or is removed, plugins should refuse to run
+ *   (return non-zero) if it's not the version they were built for.
+ * - Fields are only ever appended, struct_size tells how much of the struct this pixi fills,
+ *   so a plugin built against a newer header can check if a field is present before reading it.
+ * - Everything pointed to by the context is only valid for the duration of the hook call.
+ */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PIXI_PLUGIN_ABI_VERSION 1
+
+enum pixi_plugin_mapper { pixi_plugin_lorom, pixi_plugin_sa1rom, pixi_plugin_fullsa1rom };
+
+/* hook that is being run, the hooks are listed in libplugin.h */
+enum pixi_plugin_stage {
+    pixi_plugin_after_list_parse,
+    pixi_plugin_before_sprite_patching,
+    pixi_plugin_before_core_patches,
+    pixi_plugin_after_rom_patching,
+    pixi_plugin_after_meimei
+};
+
+/* same order as the sections of list.txt */
+enum pixi_plugin_list {
+    pixi_plugin_list_sprite,
+    pixi_plugin_list_extended,
+    pixi_plugin_list_cluster,
+    pixi_plugin_list_minor_extended,
+    pixi_plugin_list_bounce,
+    pixi_plugin_list_smoke,
+    pixi_plugin_list_spinningcoin,
+    pixi_plugin_list_score,
+    pixi_plugin_list_count
+};
+
+/* a sprite as parsed from list.txt and its cfg/json file, pointers are SNES addresses */
+typedef struct pixi_plugin_sprite {
+    int line;       /* line in list.txt */
+    int number;
+    int level;      /* 0x200 for global sprites */
+    int type;       /* 0 = tweak, 1 = custom, 2 = generator/shooter, 3+ = other */
+    int actlike;
+    unsigned char tweak[6];
+    unsigned char extra_prop[2];
+    int init_ptr;
+    int main_ptr;   /* for misc sprite types this is the only pointer */
+    int byte_count;
+    int extra_byte_count;
+    const char* directory;
+    const char* asm_file;
+    const char* cfg_file; /* empty for misc sprite types */
+} pixi_plugin_sprite;
+
+typedef struct pixi_plugin_sprite_list {
+    const pixi_plugin_sprite* sprites; /* only the slots that were filled by list.txt, in slot order */
+    int count;
+} pixi_plugin_sprite_list;
+
+typedef struct pixi_plugin_context {
+    unsigned int abi_version;
+    unsigned int struct_size;
+    int pixi_version; /* same format as pixi_check_version */
+
+    /* ROM buffer without the copier header, NULL when the hook runs while the ROM isn't loaded.
+       Plugins may change bytes in place but not the size, pixi writes the buffer back to disk. */
+    unsigned char* rom_data;
+    int rom_size;
+    int rom_mapper; /* one of pixi_plugin_mapper */
+
+    pixi_plugin_sprite_list lists[pixi_plugin_list_count];
+
+    /* address translation for the current mapper, return -1 if the address isn't mapped to the ROM */
+    int (*snes_to_pc)(const struct pixi_plugin_context* context, int snes_address);
+    int (*pc_to_snes)(const struct pixi_plugin_context* context, int pc_address);
+    /* recomputes the internal header checksum, pixi also does it once right before the ROM is written */
+    void (*fix_checksum)(struct pixi_plugin_context* context);
+
+    void* internal; /* reserved for pixi */
+
+    int stage; /* one of pixi_plugin_stage */
+    /* make an in-memory file available to every patch applied after the hook, asar can incsrc/incbin it by path.
+       The contents are copied, adding a path that was already added replaces it. Returns 0 on success. */
+    int (*add_memory_file)(struct pixi_plugin_context* context, const char* path, const void* data, size_t size);
+    /* make a define available to every patch applied after the hook, name is without the leading !.
+       The strings are copied. Returns 0 on success. */
+    int (*add_define)(struct pixi_plugin_context* context, const char* name, const char* value);
+} pixi_plugin_context;
+
+typedef int (*pixi_plugin_context_hook)(pixi_plugin_context* context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,120 @@
+#include "plugin_context.h"
+#include "../structs.h"
+#include <algorithm>
+
+namespace plugins {
+
+static plugin_context* owner(const pixi_plugin_context* context) {
+    return static_cast<plugin_context*>(context->internal);
+}
+
+static int context_snes_to_pc(const pixi_plugin_context* context, int snes_address) {
+    const ROM* rom = owner(context)->rom();
+    if (rom == nullptr)
+        return -1;
+    int pc = rom->snes_to_pc(snes_address, false);
+    return pc < rom->size ? pc : -1;
+}
+
+static int context_pc_to_snes(const pixi_plugin_context* context, int pc_address) {
+    const ROM* rom = owner(context)->rom();
+    if (rom == nullptr || pc_address < 0 || pc_address >= rom->size)
+        return -1;
+    return rom->pc_to_snes(pc_address, false);
+}
+
+static void context_fix_checksum(pixi_plugin_context* context) {
+    if (ROM* rom = owner(context)->rom())
+        rom->fix_checksum();
+}
+
+int context_add_memory_file(pixi_plugin_context* context, const char* path, const void* data, size_t size) {
+    plugin_context* self = owner(context);
+    if (self->m_asar_files == nullptr || path == nullptr || (data == nullptr && size != 0))
+        return EXIT_FAILURE;
+    const auto* bytes = static_cast<const unsigned char*>(data);
+    auto it = std::find_if(self->m_files.begin(), self->m_files.end(),
+                           [&](const plugin_context::owned_file& file) { return file.path == path; });
+    if (it == self->m_files.end()) {
+        self->m_files.push_back({path, {bytes, bytes + size}});
+        const auto& file = self->m_files.back();
+        self->m_asar_files->push_back({file.path.c_str(), file.data.data(), file.data.size()});
+        return EXIT_SUCCESS;
+    }
+    it->data.assign(bytes, bytes + size);
+    for (memoryfile& file : *self->m_asar_files) {
+        if (file.path == it->path.c_str()) {
+            file.buffer = it->data.data();
+            file.length = it->data.size();
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+int context_add_define(pixi_plugin_context* context, const char* name, const char* value) {
+    plugin_context* self = owner(context);
+    if (self->m_asar_defines == nullptr || name == nullptr || value == nullptr)
+        return EXIT_FAILURE;
+    self->m_defines.push_back({name, value});
+    const auto& define = self->m_defines.back();
+    for (definedata& existing : *self->m_asar_defines) {
+        if (define.name == existing.name) {
+            existing.contents = define.value.c_str();
+            return EXIT_SUCCESS;
+        }
+    }
+    self->m_asar_defines->push_back({define.name.c_str(), define.value.c_str()});
+    return EXIT_SUCCESS;
+}
+
+plugin_context::plugin_context(int pixi_version) {
+    m_context.abi_version = PIXI_PLUGIN_ABI_VERSION;
+    m_context.struct_size = sizeof(pixi_plugin_context);
+    m_context.pixi_version = pixi_version;
+    m_context.snes_to_pc = context_snes_to_pc;
+    m_context.pc_to_snes = context_pc_to_snes;
+    m_context.fix_checksum = context_fix_checksum;
+    m_context.add_memory_file = context_add_memory_file;
+    m_context.add_define = context_add_define;
+    m_context.internal = this;
+    set_rom(nullptr);
+}
+
+void plugin_context::set_sprite_list(ListType type, std::span<const sprite> sprites) {
+    auto& list = m_lists[FromEnum(type)];
+    list.clear();
+    for (const sprite& spr : sprites) {
+        if (spr.asm_file.empty() && spr.cfg_file.empty())
+            continue;
+        pixi_plugin_sprite& out = list.emplace_back();
+        out.line = spr.line;
+        out.number = spr.number;
+        out.level = spr.level;
+        out.type = spr.table.type;
+        out.actlike = spr.table.actlike;
+        std::copy(std::begin(spr.table.tweak), std::end(spr.table.tweak), out.tweak);
+        std::copy(std::begin(spr.table.extra), std::end(spr.table.extra), out.extra_prop);
+        out.init_ptr = spr.table.init.addr();
+        out.main_ptr = spr.table.main.addr();
+        out.byte_count = spr.byte_count;
+        out.extra_byte_count = spr.extra_byte_count;
+        out.directory = spr.directory.c_str();
+        out.asm_file = spr.asm_file.c_str();
+        out.cfg_file = spr.cfg_file.c_str();
+    }
+    m_context.lists[FromEnum(type)] = {list.data(), static_cast<int>(list.size())};
+}
+
+void plugin_context::set_asar_inputs(std::vector<memoryfile>& files, std::vector<definedata>& defines) {
+    m_asar_files = &files;
+    m_asar_defines = &defines;
+}
+
+void plugin_context::set_rom(ROM* rom) {
+    m_rom = rom;
+    m_context.rom_data = rom != nullptr ? rom->real_data : nullptr;
+    m_context.rom_size = rom != nullptr ? rom->size : 0;
+    m_context.rom_mapper = rom != nullptr ? static_cast<int>(rom->mapper) : pixi_plugin_lorom;
+}
+
+} // namespace plugins
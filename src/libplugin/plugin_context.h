@@ -0,0 +1,70 @@
+#pragma once
+#include "../config.h"
+#include "pixi_plugin.h"
+#include <array>
+#include <deque>
+#include <span>
+#include <string>
+#include <vector>
+
+struct ROM;
+struct sprite;
+struct memoryfile;
+struct definedata;
+
+namespace plugins {
+
+// owns the pixi_plugin_context handed to the hooks and the flattened sprite lists it points to.
+// the strings in the sprite lists point into the pixi sprites, so those must outlive the hook calls.
+class plugin_context {
+  public:
+    struct owned_file {
+        std::string path;
+        std::vector<unsigned char> data;
+    };
+
+  private:
+    struct owned_define {
+        std::string name;
+        std::string value;
+    };
+
+    pixi_plugin_context m_context{};
+    std::array<std::vector<pixi_plugin_sprite>, FromEnum(ListType::__SIZE__)> m_lists{};
+    // deques so that the strings and buffers handed to asar never move
+    std::deque<owned_file> m_files{};
+    std::deque<owned_define> m_defines{};
+    std::vector<memoryfile>* m_asar_files = nullptr;
+    std::vector<definedata>* m_asar_defines = nullptr;
+    ROM* m_rom = nullptr;
+
+    friend int context_add_memory_file(pixi_plugin_context*, const char*, const void*, size_t);
+    friend int context_add_define(pixi_plugin_context*, const char*, const char*);
+
+  public:
+    explicit plugin_context(int pixi_version);
+    plugin_context(const plugin_context&) = delete;
+    plugin_context& operator=(const plugin_context&) = delete;
+
+    // only the slots filled by list.txt are exposed
+    void set_sprite_list(ListType type, std::span<const sprite> sprites);
+    // pass nullptr once the rom has been written back to disk
+    void set_rom(ROM* rom);
+    // where the files and defines added by plugins end up, they must outlive the context
+    void set_asar_inputs(std::vector<memoryfile>& files, std::vector<definedata>& defines);
+    void set_stage(pixi_plugin_stage stage) {
+        m_context.stage = stage;
+    }
+    // files added by the plugins, in the order they were first added
+    const std::deque<owned_file>& added_files() const {
+        return m_files;
+    }
+    ROM* rom() const {
+        return m_rom;
+    }
+    pixi_plugin_context* get() {
+        return &m_context;
+    }
+};
+
+} // namespace plugins
@@ -0,0 +1,88 @@
+#include "list_lexer.h"
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <utility>
+
+namespace {
+
+constexpr std::string_view WHITESPACE = " \t\r\f\v"sv;
+
+constexpr std::array<std::pair<std::string_view, ListType>, FromEnum(ListType::__SIZE__)> LIST_HEADERS{{
+    {"SPRITE:"sv, ListType::Sprite},
+    {"CLUSTER:"sv, ListType::Cluster},
+    {"EXTENDED:"sv, ListType::Extended},
+    {"MINOREXTENDED:"sv, ListType::MinorExtended},
+    {"BOUNCE:"sv, ListType::Bounce},
+    {"SMOKE:"sv, ListType::Smoke},
+    {"SPINNINGCOIN:"sv, ListType::SpinningCoin},
+    {"SCORE:"sv, ListType::Score},
+}};
+
+// the whole of text has to be the number
+bool parse_hex(std::string_view text, unsigned int& value) {
+    if (text.empty())
+        return false;
+    const auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value, 16);
+    return ec == std::errc{} && end == text.data() + text.size();
+}
+
+} // namespace
+
+bool list_lexer::next(list_line& line) {
+    std::string_view raw{};
+    while (m_lines.next(raw)) {
+        m_lineno++;
+        std::string_view text = raw.substr(0, raw.find(';'));
+        const size_t start = text.find_first_not_of(WHITESPACE);
+        if (start == std::string_view::npos)
+            continue;
+        text = text.substr(start, text.find_last_not_of(WHITESPACE) + 1 - start);
+
+        line = list_line{};
+        line.lineno = m_lineno;
+        line.text = text;
+        auto malformed = [&](const char* error, size_t pos) {
+            line.type = list_line::kind::malformed;
+            line.error = error;
+            line.column = start + pos + 1;
+            return true;
+        };
+
+        const size_t first_end = std::min(text.find_first_of(WHITESPACE), text.size());
+        const std::string_view first = text.substr(0, first_end);
+        if (first_end == text.size() && first.ends_with(':')) {
+            const auto header = std::find_if(LIST_HEADERS.begin(), LIST_HEADERS.end(),
+                                             [first](const auto& known) { return known.first == first; });
+            if (header == LIST_HEADERS.end()) {
+                line.type = list_line::kind::unknown_header;
+            } else {
+                line.type = list_line::kind::header;
+                line.list_type = header->second;
+            }
+            return true;
+        }
+
+        // a ':' in the filename doesn't make it a per-level sprite, only one in the first token does
+        const size_t colon = first.find(':');
+        size_t number_pos = 0;
+        if (colon != std::string_view::npos) {
+            if (!parse_hex(first.substr(0, colon), line.level))
+                return malformed("expected a level number in hex before the ':'", 0);
+            line.per_level = true;
+            number_pos = colon + 1;
+        }
+        if (!parse_hex(first.substr(number_pos), line.number))
+            return malformed("expected a sprite number in hex", number_pos);
+        if (first_end == text.size())
+            return malformed("missing the filename after the sprite number", first_end);
+
+        line.filename = text.substr(text.find_first_not_of(WHITESPACE, first_end));
+        const size_t dot = line.filename.rfind('.');
+        if (dot != std::string_view::npos)
+            line.extension = line.filename.substr(dot + 1);
+        line.type = list_line::kind::sprite;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,45 @@
+#ifndef LIST_LEXER_H
+#define LIST_LEXER_H
+#include "config.h"
+#include "file_io.h"
+#include <cstddef>
+#include <string_view>
+
+// one line of list.txt, every string_view points into the text given to the list_lexer
+struct list_line {
+    enum class kind { sprite, header, unknown_header, malformed };
+
+    kind type = kind::malformed;
+    int lineno = 0;
+    std::string_view text{}; // the line without its comment and surrounding whitespace
+    // header
+    ListType list_type = ListType::Sprite;
+    // sprite, level is 0x200 for sprites that aren't per-level
+    unsigned int level = 0x200;
+    unsigned int number = 0;
+    bool per_level = false;
+    std::string_view filename{};
+    std::string_view extension{}; // after the last '.' of the filename, empty when there's none
+    // malformed
+    const char* error = nullptr;
+    size_t column = 0; // 1 based, in the line as it is in the file
+};
+
+/**
+    Splits list.txt into lines and tokens in a single pass without copying any of it. The possible lines are
+        [xxx:]yy filename.<cfg/json/asm> [; ...]
+        TYPE: [; ...]
+    with empty and comment only lines skipped.
+*/
+class list_lexer {
+    line_reader m_lines;
+    int m_lineno = 0;
+
+  public:
+    explicit list_lexer(std::string_view text) : m_lines{text} {
+    }
+    // false once every line has been read, malformed lines are returned with the reason and column of the problem
+    [[nodiscard]] bool next(list_line& line);
+};
+
+#endif
@@ -1,4 +1,5 @@
 #pragma once
+#include "file_io.h"
 #include "structs.h"
 #include "map16.h"
 #include <utility>
@@ -6,8 +7,13 @@
 #include <vector>
 #include <string>
 
-bool generate_lm_data(const sprite (&sprite_list)[MAX_SPRITE_COUNT], map16 (&map)[MAP16_SIZE],
-                      unsigned char (&extra_bytes)[0x200], FILE* ssc, FILE* mwt, FILE* mw2, FILE* s16, bool perlevel);
+// sizes of the sprite data of each sprite number, the first 0x100 without extra bit and the others with it
+// with perlevel, the numbers in per_level_slots get the fixed size that per-level sprites use
+void generate_extra_bytes(const sprite (&sprite_list)[MAX_SPRITE_COUNT], unsigned char (&extra_bytes)[0x200],
+                          bool perlevel, per_level_range per_level_slots);
+bool generate_lm_data(const sprite (&sprite_list)[MAX_SPRITE_COUNT], map16 (&map)[MAP16_SIZE], file_writer& ssc,
+                      file_writer& mwt, file_writer& mw2, file_writer& s16, bool perlevel,
+                      per_level_range per_level_slots);
 
 std::pair<size_t, std::span<const map16>> generate_s16_data(const sprite* spr, const map16* map, size_t map_size);
 std::string generate_mwt_data(const sprite* spr, const collection& c, bool first);
@@ -0,0 +1,84 @@
+#include "manifest.h"
+#include "file_io.h"
+#include "structs.h"
+#include <nlohmann/json.hpp>
+#include <set>
+
+using json = nlohmann::ordered_json;
+
+// same names as the list.txt sections
+constexpr std::array<const char*, FromEnum(ListType::__SIZE__)> list_names{
+    "sprite", "extended", "cluster", "minorextended", "bounce", "smoke", "spinningcoin", "score"};
+
+static json pointer_json(const pointer& ptr) {
+    if (ptr.is_empty() || ptr.addr() == 0x000000)
+        return nullptr;
+    return ptr.addr();
+}
+
+static json sprite_json(const sprite& spr, size_t slot) {
+    json entry{
+        {"slot", slot},
+        {"number", spr.number},
+        {"line", spr.line},
+    };
+    if (spr.level < 0x200)
+        entry["level"] = spr.level;
+    entry["type"] = spr.table.type;
+    entry["asm_file"] = spr.asm_file;
+    if (!spr.cfg_file.empty())
+        entry["cfg_file"] = spr.cfg_file;
+    entry["init"] = pointer_json(spr.table.init);
+    entry["main"] = pointer_json(spr.table.main);
+    if (spr.sprite_type == ListType::Sprite) {
+        entry["carriable"] = pointer_json(spr.ptrs.carriable);
+        entry["kicked"] = pointer_json(spr.ptrs.kicked);
+        entry["carried"] = pointer_json(spr.ptrs.carried);
+        entry["mouth"] = pointer_json(spr.ptrs.mouth);
+        entry["goal"] = pointer_json(spr.ptrs.goal);
+    } else if (spr.sprite_type == ListType::Extended) {
+        entry["cape"] = pointer_json(spr.extended_cape_ptr);
+    }
+    const pointer& code = spr.table.main.is_empty() ? spr.table.init : spr.table.main;
+    entry["bank"] = code.is_empty() ? json(nullptr) : json(code.bankbyte);
+    entry["size"] = spr.insert_size < 0 ? json(nullptr) : json(spr.insert_size);
+    entry["routines"] = spr.routines;
+    return entry;
+}
+
+void write_manifest(file_writer& out, const std::string& rom_name, const sprite_lists_view& lists,
+                    const std::map<std::string, inserted_routine>& routines) {
+    json manifest{{"rom", rom_name}};
+
+    json lists_json = json::object();
+    for (size_t type = 0; type < lists.size(); type++) {
+        json entries = json::array();
+        std::set<std::string_view> counted{};
+        int bytes = 0;
+        for (size_t slot = 0; slot < lists[type].size(); slot++) {
+            const sprite& spr = lists[type][slot];
+            if (spr.asm_file.empty() && spr.cfg_file.empty())
+                continue;
+            entries.push_back(sprite_json(spr, slot));
+            if (spr.insert_size > 0 && counted.insert(spr.asm_file).second)
+                bytes += spr.insert_size;
+        }
+        lists_json[list_names[type]] = {{"count", entries.size()}, {"bytes", bytes}, {"sprites", std::move(entries)}};
+    }
+    manifest["lists"] = std::move(lists_json);
+
+    json routine_entries = json::array();
+    int routine_bytes = 0;
+    for (const auto& [name, routine] : routines) {
+        routine_entries.push_back({{"name", name},
+                                   {"address", routine.address},
+                                   {"size", routine.size < 0 ? json(nullptr) : json(routine.size)}});
+        if (routine.size > 0)
+            routine_bytes += routine.size;
+    }
+    manifest["routines"] = {
+        {"count", routine_entries.size()}, {"bytes", routine_bytes}, {"inserted", std::move(routine_entries)}};
+
+    out.write(manifest.dump(4));
+    out.put('\n');
+}
@@ -0,0 +1,33 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+#include "config.h"
+#include <array>
+#include <map>
+#include <span>
+#include <string>
+
+struct sprite;
+class file_writer;
+
+// a shared routine inserted during this run, size is -1 if it couldn't be measured
+struct inserted_routine {
+    int address = 0;
+    int size = -1;
+};
+
+using sprite_lists_view = std::array<std::span<const sprite>, FromEnum(ListType::__SIZE__)>;
+
+/**
+    Writes a JSON description of what has been inserted: for every filled list slot its number, level, type,
+    source files, pointers, size, bank and the shared routines it uses, with totals per list and for the routines.
+    Slots that share the same asm file share the same code, so it's only counted once in the totals.
+
+    @param out is where the manifest is written, it's up to the caller to commit it
+    @param rom_name is the name of the rom the sprites were inserted into
+    @param lists are the sprite lists, indexed by ListType
+    @param routines are the shared routines inserted during this run, by name
+*/
+void write_manifest(file_writer& out, const std::string& rom_name, const sprite_lists_view& lists,
+                    const std::map<std::string, inserted_routine>& routines);
+
+#endif
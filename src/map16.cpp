@@ -19,7 +19,8 @@ size_t find_free_map(const map16* const map, size_t map_size, size_t count) {
 }
 
 void read_map16(map16* map, const char* file) {
-    auto* src = (map16*)read_all(file, false, MAP16_SIZE * sizeof(map16));
-    memcpy(map, src, MAP16_SIZE * sizeof(map16));
-    delete[] src;
+    file_buffer src{};
+    if (!src.open(file))
+        return;
+    memcpy(map, src.data(), std::min(src.size(), MAP16_SIZE * sizeof(map16)));
 }
@@ -43,11 +43,11 @@ PIXI_EXPORT pixi_list_result_t pixi_parse_list_file(const char* filename, bool p
     std::vector<sprite> sprite_list{per_level ? MAX_SPRITE_COUNT : 0x100ull};
     std::vector<sprite> cluster_list{SPRITE_COUNT};
     std::vector<sprite> extended_list{SPRITE_COUNT};
-    std::vector<sprite> minor_extended_list{LESS_SPRITE_COUNT};
-    std::vector<sprite> bounce_list{LESS_SPRITE_COUNT};
-    std::vector<sprite> smoke_list{LESS_SPRITE_COUNT};
-    std::vector<sprite> spinningcoin_list{MINOR_SPRITE_COUNT};
-    std::vector<sprite> score_list{MINOR_SPRITE_COUNT};
+    std::vector<sprite> minor_extended_list{SPRITE_COUNT};
+    std::vector<sprite> bounce_list{SPRITE_COUNT};
+    std::vector<sprite> smoke_list{SPRITE_COUNT};
+    std::vector<sprite> spinningcoin_list{SPRITE_COUNT};
+    std::vector<sprite> score_list{SPRITE_COUNT};
     std::array sprites_list_list{sprite_list.data(),         extended_list.data(), cluster_list.data(),
                                  minor_extended_list.data(), bounce_list.data(),   smoke_list.data(),
                                  spinningcoin_list.data(),   score_list.data()};
@@ -0,0 +1,384 @@
+#include "profiler.h"
+#include "cpu65816.h"
+#include "iohandler.h"
+#include "structs.h"
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+
+// a call that takes longer than this is considered stuck (e.g. waiting on a hardware register that never changes)
+constexpr uint64_t MAX_CALL_CYCLES = 2'000'000;
+// approximate CPU cycles in a NTSC frame: 357368 master cycles at 8 master cycles per access for the S-CPU,
+// 10.74MHz / 60.1Hz for the SA-1
+constexpr double SCPU_FRAME_CYCLES = 357368.0 / 8.0;
+constexpr double SA1_FRAME_CYCLES = 10738636.0 / 60.1;
+constexpr int PROFILE_SLOT = 0;
+
+// addresses of the sprite tables used to set up a sprite, see sa1def.asm
+struct sprite_ram_layout {
+    uint32_t dp;
+    uint32_t addr;
+    uint32_t stack;
+    uint32_t number;
+    uint32_t status;
+    uint32_t x_low;
+    uint32_t x_high;
+    uint32_t y_low;
+    uint32_t y_high;
+    uint32_t extra_bits;
+    uint32_t new_sprite_num;
+    uint32_t extra_prop_1;
+    uint32_t extra_prop_2;
+    uint32_t tweak[6];
+    uint32_t palette;
+};
+
+constexpr sprite_ram_layout lorom_layout{
+    .dp = 0x0000,
+    .addr = 0x0000,
+    .stack = 0x01FF,
+    .number = 0x9E,
+    .status = 0x14C8,
+    .x_low = 0xE4,
+    .x_high = 0x14E0,
+    .y_low = 0xD8,
+    .y_high = 0x14D4,
+    .extra_bits = 0x7FAB10,
+    .new_sprite_num = 0x7FAB9E,
+    .extra_prop_1 = 0x7FAB28,
+    .extra_prop_2 = 0x7FAB34,
+    .tweak = {0x1656, 0x1662, 0x166E, 0x167A, 0x1686, 0x190F},
+    .palette = 0x15F6,
+};
+
+constexpr sprite_ram_layout sa1_layout{
+    .dp = 0x3000,
+    .addr = 0x6000,
+    .stack = 0x37FF,
+    .number = 0x3200,
+    .status = 0x3242,
+    .x_low = 0x322C,
+    .x_high = 0x326E,
+    .y_low = 0x3216,
+    .y_high = 0x3258,
+    .extra_bits = 0x6040,
+    .new_sprite_num = 0x6083,
+    .extra_prop_1 = 0x6057,
+    .extra_prop_2 = 0x606D,
+    .tweak = {0x75D0, 0x75EA, 0x7600, 0x7616, 0x762C, 0x7658},
+    .palette = 0x33B8,
+};
+
+// memory map of the cpu that runs sprites: the S-CPU on lorom, the SA-1 on sa-1 roms
+class smw_bus final : public snes_bus {
+    const ROM& m_rom;
+    const bool m_sa1;
+    std::vector<uint8_t> m_wram = std::vector<uint8_t>(0x20000);
+    std::vector<uint8_t> m_iram = std::vector<uint8_t>(0x800);
+    std::vector<uint8_t> m_bwram = std::vector<uint8_t>(0x40000);
+    std::vector<uint8_t> m_io = std::vector<uint8_t>(0x4000);
+
+    uint8_t& io(uint32_t offset) {
+        return m_io[offset - 0x2000];
+    }
+    uint16_t io16(uint32_t offset) {
+        return static_cast<uint16_t>(io(offset) | (io(offset + 1) << 8));
+    }
+    void set_io16(uint32_t offset, uint16_t value) {
+        io(offset) = static_cast<uint8_t>(value);
+        io(offset + 1) = static_cast<uint8_t>(value >> 8);
+    }
+
+    // the hardware math units are the only registers that sprites commonly read back
+    void io_written(uint32_t offset) {
+        if (offset == 0x4203) {
+            set_io16(0x4216, static_cast<uint16_t>(io(0x4202) * io(0x4203)));
+        } else if (offset == 0x4206) {
+            uint16_t dividend = io16(0x4204);
+            uint8_t divisor = io(0x4206);
+            set_io16(0x4214, divisor == 0 ? 0xFFFF : static_cast<uint16_t>(dividend / divisor));
+            set_io16(0x4216, divisor == 0 ? dividend : static_cast<uint16_t>(dividend % divisor));
+        } else if (offset == 0x2254) {
+            auto a = static_cast<int16_t>(io16(0x2251));
+            if ((io(0x2250) & 0x01) == 0) {
+                auto product = static_cast<uint32_t>(a * static_cast<int16_t>(io16(0x2253)));
+                set_io16(0x2306, static_cast<uint16_t>(product));
+                set_io16(0x2308, static_cast<uint16_t>(product >> 16));
+            } else {
+                uint16_t b = io16(0x2253);
+                set_io16(0x2306, b == 0 ? 0 : static_cast<uint16_t>(a / b));
+                set_io16(0x2308, b == 0 ? 0 : static_cast<uint16_t>(a % b));
+            }
+        }
+    }
+
+    uint8_t* ram(uint32_t address) {
+        const uint32_t bank = address >> 16;
+        const uint32_t offset = address & 0xFFFF;
+        if (bank == 0x7E || bank == 0x7F)
+            return &m_wram[address - 0x7E0000];
+        if ((bank & 0x40) == 0) {
+            if (offset < 0x2000) {
+                if (m_sa1 && offset < 0x800)
+                    return &m_iram[offset];
+                return &m_wram[offset];
+            }
+            if (m_sa1 && offset >= 0x3000 && offset < 0x3800)
+                return &m_iram[offset - 0x3000];
+            if (offset < 0x6000)
+                return &io(offset);
+            if (m_sa1 && offset < 0x8000)
+                return &m_bwram[offset - 0x6000];
+        } else if (m_sa1 && bank >= 0x40 && bank < 0x50) {
+            return &m_bwram[(address - 0x400000) % m_bwram.size()];
+        }
+        return nullptr;
+    }
+
+  public:
+    smw_bus(const ROM& rom) : m_rom{rom}, m_sa1{rom.mapper != MapperType::lorom} {
+    }
+
+    void clear() {
+        std::fill(m_wram.begin(), m_wram.end(), uint8_t{0});
+        std::fill(m_iram.begin(), m_iram.end(), uint8_t{0});
+        std::fill(m_bwram.begin(), m_bwram.end(), uint8_t{0});
+        std::fill(m_io.begin(), m_io.end(), uint8_t{0});
+    }
+
+    uint8_t read(uint32_t address) override {
+        if (uint8_t* cell = ram(address))
+            return *cell;
+        int pc = m_rom.snes_to_pc(static_cast<int>(address), false);
+        if (pc < 0 || pc >= m_rom.size)
+            return 0;
+        return m_rom.real_data[pc];
+    }
+
+    void write(uint32_t address, uint8_t value) override {
+        if (uint8_t* cell = ram(address)) {
+            *cell = value;
+            if ((address & 0x40FFFF) >= 0x2000 && (address & 0x40FFFF) < 0x6000)
+                io_written(address & 0xFFFF);
+        }
+    }
+};
+
+struct routine_usage {
+    uint64_t cycles = 0;
+    int calls = 0;
+};
+
+struct call_result {
+    bool returned = false;
+    uint64_t cycles = 0;
+};
+
+class sprite_runner {
+    const ROM& m_rom;
+    smw_bus m_bus;
+    cpu65816 m_cpu;
+    const sprite_ram_layout& m_layout;
+    // pc offset of each shared routine -> index in the routine name list
+    std::unordered_map<int, size_t> m_routines{};
+
+    struct open_call {
+        size_t routine;
+        uint16_t stack;
+        uint64_t start;
+    };
+    std::vector<open_call> m_calls{};
+
+  public:
+    std::map<size_t, routine_usage> routine_cycles{};
+    uint64_t cycles_in_routines = 0;
+
+    sprite_runner(const ROM& rom, const std::vector<std::string>& routine_names)
+        : m_rom{rom}, m_bus{rom}, m_cpu{m_bus}, m_layout{rom.mapper == MapperType::lorom ? lorom_layout : sa1_layout} {
+        for (size_t i = 0; i < routine_names.size(); i++) {
+            int address = rom.pointer_snes(0x03E05C + static_cast<int>(i) * 3).addr();
+            if (address == 0xFFFFFF)
+                continue;
+            int pc = rom.snes_to_pc(address, false);
+            if (pc >= 0)
+                m_routines[pc] = i;
+        }
+    }
+
+    void poke(uint32_t address, uint8_t value) {
+        m_bus.write(address, value);
+    }
+    uint8_t peek(uint32_t address) {
+        return m_bus.read(address);
+    }
+    uint8_t status() {
+        return peek(m_layout.status + PROFILE_SLOT);
+    }
+
+    // stub level state: level game mode, mario standing to the left of the sprite, both on screen
+    void setup(const sprite& spr) {
+        const auto& l = m_layout;
+        m_bus.clear();
+        poke(l.addr | 0x0100, 0x14);
+        poke(l.dp | 0x94, 0x50);
+        poke(l.dp | 0x96, 0x40);
+        poke(l.dp | 0x97, 0x01);
+        poke(l.dp | 0x1C, 0xC0);
+        poke(l.addr | 0x15E9, PROFILE_SLOT);
+        poke(l.number + PROFILE_SLOT, spr.table.actlike);
+        poke(l.x_low + PROFILE_SLOT, 0x80);
+        poke(l.y_low + PROFILE_SLOT, 0x40);
+        poke(l.y_high + PROFILE_SLOT, 0x01);
+        poke(l.extra_bits + PROFILE_SLOT, 0x08);
+        poke(l.new_sprite_num + PROFILE_SLOT, static_cast<uint8_t>(spr.number));
+        poke(l.extra_prop_1 + PROFILE_SLOT, spr.table.extra[0]);
+        poke(l.extra_prop_2 + PROFILE_SLOT, spr.table.extra[1]);
+        for (size_t i = 0; i < std::size(l.tweak); i++)
+            poke(l.tweak[i] + PROFILE_SLOT, spr.table.tweak[i]);
+        poke(l.palette + PROFILE_SLOT, spr.table.tweak[2] & 0x0F);
+    }
+
+    void next_frame() {
+        const auto& l = m_layout;
+        poke(l.dp | 0x13, static_cast<uint8_t>(peek(l.dp | 0x13) + 1));
+        poke(l.dp | 0x14, static_cast<uint8_t>(peek(l.dp | 0x14) + 1));
+    }
+
+    // JSLs to the pointer and runs until the matching RTL
+    call_result call(const pointer& ptr, uint8_t status, bool track_routines) {
+        const auto& l = m_layout;
+        poke(l.status + PROFILE_SLOT, status);
+        m_cpu.reset_native();
+        m_cpu.A = status;
+        m_cpu.X = PROFILE_SLOT;
+        m_cpu.Y = 0;
+        m_cpu.D = static_cast<uint16_t>(l.dp);
+        m_cpu.DB = 0x01;
+        m_cpu.S = static_cast<uint16_t>(l.stack);
+        const uint16_t base_stack = m_cpu.S;
+        m_cpu.push8(0x00);
+        m_cpu.push16(0xFFFF);
+        m_cpu.PB = ptr.bankbyte;
+        m_cpu.PC = static_cast<uint16_t>(ptr.addr());
+        m_calls.clear();
+
+        while (m_cpu.cycles < MAX_CALL_CYCLES) {
+            if (track_routines)
+                enter_routine();
+            m_cpu.step();
+            if (m_cpu.stopped != cpu_stop::none)
+                return {false, m_cpu.cycles};
+            const uint8_t op = m_cpu.last_opcode;
+            if (op == 0x6B || op == 0x60 || op == 0x40) {
+                if (track_routines)
+                    leave_routines();
+                if (op == 0x6B && m_cpu.S == base_stack)
+                    return {true, m_cpu.cycles};
+            }
+        }
+        return {false, m_cpu.cycles};
+    }
+
+    uint32_t cpu_address() const {
+        return (m_cpu.PB << 16) | m_cpu.PC;
+    }
+
+  private:
+    void enter_routine() {
+        const uint32_t pc = cpu_address();
+        if (m_cpu.read8(pc) != 0x22) // JSL
+            return;
+        const int target = m_rom.snes_to_pc(static_cast<int>(m_cpu.read24(pc + 1)), false);
+        auto it = m_routines.find(target);
+        if (it != m_routines.end())
+            m_calls.push_back({it->second, m_cpu.S, m_cpu.cycles});
+    }
+
+    // a routine is done once the stack is back where it was before its JSL, this also handles routines that pull
+    // their return address to return from their caller directly
+    void leave_routines() {
+        while (!m_calls.empty() && m_cpu.S >= m_calls.back().stack) {
+            const open_call& open = m_calls.back();
+            const uint64_t elapsed = m_cpu.cycles - open.start;
+            auto& usage = routine_cycles[open.routine];
+            usage.cycles += elapsed;
+            usage.calls++;
+            if (m_calls.size() == 1)
+                cycles_in_routines += elapsed;
+            m_calls.pop_back();
+        }
+    }
+};
+
+void profile_sprites(const ROM& rom, std::span<const sprite> sprites, const std::vector<std::string>& routine_names,
+                     int frames) {
+    iohandler& io = iohandler::get_global();
+    const bool sa1 = rom.mapper != MapperType::lorom;
+    const double frame_cycles = sa1 ? SA1_FRAME_CYCLES : SCPU_FRAME_CYCLES;
+    io.print("\nProfiling INIT and %d MAIN frame(s) per sprite on the %s (CPU cycles):\n", frames,
+             sa1 ? "SA-1" : "S-CPU");
+
+    sprite_runner runner{rom, routine_names};
+    std::unordered_set<std::string> profiled{};
+    for (const sprite& spr : sprites) {
+        if (spr.asm_file.empty() || spr.table.type != 1 || spr.sprite_type != ListType::Sprite)
+            continue;
+        if (!profiled.insert(spr.asm_file).second)
+            continue;
+        std::string name = spr.level < 0x200 ? fstring("%03X:%02X", spr.level, spr.number) : fstring("%02X", spr.number);
+
+        runner.routine_cycles.clear();
+        runner.cycles_in_routines = 0;
+        runner.setup(spr);
+        uint64_t init_cycles = 0;
+        if (!spr.table.init.is_empty()) {
+            auto init = runner.call(spr.table.init, 0x01, false);
+            if (!init.returned) {
+                io.print("  %s %s: INIT didn't return (stopped at $%06X after %llu cycles)\n", name.c_str(),
+                         spr.asm_file.c_str(), runner.cpu_address(), static_cast<unsigned long long>(init.cycles));
+                continue;
+            }
+            init_cycles = init.cycles;
+        }
+
+        uint64_t main_total = 0;
+        uint64_t main_max = 0;
+        int main_frames = 0;
+        bool stuck = false;
+        for (int i = 0; i < frames && !spr.table.main.is_empty(); i++) {
+            auto main = runner.call(spr.table.main, 0x08, true);
+            if (!main.returned) {
+                io.print("  %s %s: MAIN didn't return on frame %d (stopped at $%06X after %llu cycles)\n",
+                         name.c_str(), spr.asm_file.c_str(), i, runner.cpu_address(),
+                         static_cast<unsigned long long>(main.cycles));
+                stuck = true;
+                break;
+            }
+            main_total += main.cycles;
+            main_max = std::max(main_max, main.cycles);
+            main_frames++;
+            // the sprite erased or killed itself, the following frames wouldn't run its code anymore
+            if (runner.status() != 0x08)
+                break;
+            runner.next_frame();
+        }
+        if (stuck)
+            continue;
+
+        const uint64_t main_avg = main_frames == 0 ? 0 : main_total / main_frames;
+        io.print("  %s %s: INIT %llu, MAIN avg %llu max %llu over %d frame(s) (%.1f%% of a frame)\n", name.c_str(),
+                 spr.asm_file.c_str(), static_cast<unsigned long long>(init_cycles),
+                 static_cast<unsigned long long>(main_avg), static_cast<unsigned long long>(main_max), main_frames,
+                 100.0 * static_cast<double>(main_avg) / frame_cycles);
+        if (!runner.routine_cycles.empty() && main_frames != 0) {
+            std::string breakdown{};
+            for (const auto& [index, usage] : runner.routine_cycles) {
+                breakdown += fstring(" %s %llu/%dx", routine_names[index].c_str(),
+                                     static_cast<unsigned long long>(usage.cycles / main_frames), usage.calls / main_frames);
+            }
+            io.print("      shared routines: %llu per frame:%s\n",
+                     static_cast<unsigned long long>(runner.cycles_in_routines / main_frames), breakdown.c_str());
+        }
+    }
+}
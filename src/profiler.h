@@ -0,0 +1,24 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+#include <span>
+#include <string>
+#include <vector>
+
+struct ROM;
+struct sprite;
+
+/**
+    Runs the INIT routine and a number of MAIN frames of every custom normal sprite on a 65816 interpreter, using the
+    patched ROM buffer and a stub SMW RAM with the sprite in slot 0, then prints the cycle counts of each sprite and the
+    cycles spent in shared routines. Calls into vanilla code are executed too, hardware registers other than the
+    multiplication/division ones read as 0.
+
+    @param rom is the ROM after all the patches have been applied
+    @param sprites is the normal sprite list (global and per-level sprites)
+    @param routine_names is the list of shared routines, in the order of their pointers at $03E05C
+    @param frames is the number of MAIN calls to run for each sprite
+*/
+void profile_sprites(const ROM& rom, std::span<const sprite> sprites, const std::vector<std::string>& routine_names,
+                     int frames);
+
+#endif
@@ -0,0 +1,120 @@
+#include "routines.h"
+#include <algorithm>
+#include <cctype>
+#include <vector>
+
+using namespace std::string_view_literals;
+
+static std::string_view trim_view(std::string_view str) {
+    constexpr auto spaces = " \t\r\n"sv;
+    auto begin = str.find_first_not_of(spaces);
+    if (begin == std::string_view::npos)
+        return {};
+    auto end = str.find_last_not_of(spaces);
+    return str.substr(begin, end - begin + 1);
+}
+
+static bool iequals(std::string_view first, std::string_view second) {
+    return std::equal(first.begin(), first.end(), second.begin(), second.end(),
+                      [](char a, char b) { return std::tolower(a) == std::tolower(b); });
+}
+
+// strips the comment from a line, ignoring semicolons in strings
+static std::string_view code_of(std::string_view line) {
+    bool in_string = false;
+    for (size_t i = 0; i < line.size(); i++) {
+        if (line[i] == '"')
+            in_string = !in_string;
+        else if (line[i] == ';' && !in_string)
+            return trim_view(line.substr(0, i));
+    }
+    return trim_view(line);
+}
+
+static bool is_word_char(char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+// counts the occurrences of word (case insensitive) that aren't part of a longer identifier
+static int count_word(std::string_view code, std::string_view word) {
+    int count = 0;
+    for (size_t i = 0; i + word.size() <= code.size(); i++) {
+        if (!iequals(code.substr(i, word.size()), word))
+            continue;
+        bool starts = i == 0 || !is_word_char(code[i - 1]);
+        bool ends = i + word.size() == code.size() || !is_word_char(code[i + word.size()]);
+        if (starts && ends)
+            count++;
+    }
+    return count;
+}
+
+bool make_inline_routine(std::string_view source, inline_routine& routine, std::string& error) {
+    routine = inline_routine{};
+    std::vector<std::string_view> code_lines{};
+    for (size_t start = 0; start < source.size();) {
+        size_t end = source.find('\n', start);
+        if (end == std::string_view::npos)
+            end = source.size();
+        std::string_view line = source.substr(start, end - start);
+        start = end + 1;
+        std::string_view trimmed = trim_view(line);
+        if (trimmed.starts_with(";@inlinable"sv)) {
+            routine.requested = true;
+        } else if (trimmed.starts_with(";@inline"sv)) {
+            routine.requested = true;
+            routine.default_inline = true;
+        }
+        std::string_view code = code_of(line);
+        if (!code.empty())
+            code_lines.push_back(code);
+    }
+    if (!routine.requested)
+        return true;
+
+    int rtl_count = 0;
+    for (std::string_view code : code_lines) {
+        for (auto forbidden : {"rts"sv, "rti"sv, "macro"sv, "endmacro"sv, "incsrc"sv, "incbin"sv}) {
+            if (count_word(code, forbidden) != 0) {
+                error = "it uses " + std::string{forbidden};
+                return false;
+            }
+        }
+        // every expansion would redefine non macro-local labels
+        std::string_view first = code.substr(0, code.find_first_of(" \t"));
+        if ((first.ends_with(':') && !first.starts_with('?')) || first.starts_with('.') || first.starts_with('+') ||
+            first.starts_with('-')) {
+            error = "it defines the label " + std::string{first} + ", only ?labels can be used in inlined routines";
+            return false;
+        }
+        if (code.find_first_of("<>") != std::string_view::npos) {
+            error = "it uses < or >, which can't appear in a macro body";
+            return false;
+        }
+        rtl_count += count_word(code, "rtl"sv);
+    }
+    if (rtl_count != 1 || code_lines.empty()) {
+        error = "it must have exactly one RTL, at the end of the routine";
+        return false;
+    }
+
+    // statements on the same line are separated by " : "
+    std::string_view last = code_lines.back();
+    auto separator = last.rfind(" : "sv);
+    std::string_view last_statement = separator == std::string_view::npos ? last : trim_view(last.substr(separator + 3));
+    if (!iequals(last_statement, "rtl"sv)) {
+        error = "its only RTL isn't the last instruction";
+        return false;
+    }
+    if (separator == std::string_view::npos)
+        code_lines.pop_back();
+    else
+        code_lines.back() = trim_view(last.substr(0, separator));
+
+    for (std::string_view code : code_lines) {
+        routine.body += "\t\t";
+        routine.body += code;
+        routine.body += '\n';
+    }
+    return true;
+}
@@ -0,0 +1,35 @@
+#ifndef ROUTINES_H
+#define ROUTINES_H
+#include <string>
+#include <string_view>
+
+// cycles spent by the JSL (8) and RTL (6) pair that an inlined call doesn't execute
+constexpr int INLINE_SAVED_CYCLES = 14;
+// size of the JSL that an inlined call replaces
+constexpr int INLINE_JSL_SIZE = 4;
+// tag printed by the inline expansion of a routine, followed by the routine name and the expansion size
+constexpr std::string_view INLINE_PRINT_TAG = "__PIXI_INLINE__";
+
+struct inline_routine {
+    bool requested = false;
+    bool default_inline = false;
+    std::string body{};
+};
+
+/**
+    Checks if a shared routine can be inlined and, if it can, turns its source into a body that can be expanded
+    inside an asar macro.
+    A line starting with ;@inline in the routine file makes every call inline by default,
+    a line starting with ;@inlinable keeps JSL as default and lets sprites opt in.
+
+    An inlinable routine must end with its only RTL and not touch the return address on the stack.
+    Its code can't use < or > (they would be taken as macro arguments), nor incsrc, incbin or macro definitions.
+
+    @param source is the content of the routine file
+    @param routine receives the annotation found and the macro body without the final RTL
+    @param error receives the reason for which the routine can't be inlined
+    @return false if the routine requested inlining but can't be inlined
+*/
+[[nodiscard]] bool make_inline_routine(std::string_view source, inline_routine& routine, std::string& error);
+
+#endif
@@ -1,9 +1,12 @@
 #include <cstdio>
 
 #include <array>
+#include <deque>
 #include <exception>
 #include <filesystem>
 #include <fstream>
+#include <map>
+#include <optional>
 #include <sstream>
 #include <unordered_map>
 #include <unordered_set>
@@ -18,14 +21,23 @@
 #endif
 #include "cfg.h"
 #include "config.h"
+#include "delta_patch.h"
 #include "file_io.h"
+#include "hashing.h"
 #include "iohandler.h"
 #include "json.h"
 #include "libconsole/libconsole.h"
 #include "libplugin/libplugin.h"
+#include "libplugin/plugin_context.h"
+#include "list_lexer.h"
 #include "lmdata.h"
+#include "manifest.h"
 #include "map16.h"
 #include "paths.h"
+#include "profiler.h"
+#include "routines.h"
+#include "symbols.h"
+#include "task_graph.h"
 
 namespace fs = std::filesystem;
 
@@ -74,14 +86,19 @@ constexpr auto GOAL_POST_SPRITE_ID = 0x7B;
 
 constexpr auto TEMP_SPR_FILE = "spr_temp.asm";
 
+// size of the lists, the tables written to the rom only go up to the highest slot in use (see misc_table_count)
 constexpr std::array<std::pair<ListType, size_t>, FromEnum(ListType::__SIZE__) - 1ull> sprite_sizes = {
     {{ListType::Extended, SPRITE_COUNT},
      {ListType::Cluster, SPRITE_COUNT},
-     {ListType::MinorExtended, LESS_SPRITE_COUNT},
-     {ListType::Bounce, LESS_SPRITE_COUNT},
-     {ListType::Smoke, LESS_SPRITE_COUNT},
-     {ListType::SpinningCoin, MINOR_SPRITE_COUNT},
-     {ListType::Score, MINOR_SPRITE_COUNT}}};
+     {ListType::MinorExtended, SPRITE_COUNT},
+     {ListType::Bounce, SPRITE_COUNT},
+     {ListType::Smoke, SPRITE_COUNT},
+     {ListType::SpinningCoin, SPRITE_COUNT},
+     {ListType::Score, SPRITE_COUNT}}};
+
+// used by --misc-capacity and for the !<name>Count defines
+constexpr std::array<std::string_view, FromEnum(ListType::__SIZE__)> misc_type_names{
+    "Sprite"sv, "Extended"sv, "Cluster"sv, "MinorExtended"sv, "Bounce"sv, "Smoke"sv, "SpinningCoin"sv, "Score"sv};
 
 constexpr std::array<PathType, FromEnum(ListType::__SIZE__)> map_list_to_path{
     PathType::Sprites,       // ListType::Sprite
@@ -95,8 +112,11 @@ constexpr std::array<PathType, FromEnum(ListType::__SIZE__)> map_list_to_path{
 };
 
 unsigned char PLS_LEVEL_PTRS[0x400];
-unsigned char PLS_SPRITE_PTRS[0x4000];
+unsigned char PLS_SPRITE_PTRS[0x8000];
 int PLS_SPRITE_PTRS_ADDR = 0;
+// level -> per-level slots from the first number of the range up to the highest one it uses,
+// each is the index in PLS_DATA + 1 or 0 if the slot isn't used
+std::map<int, std::vector<int>> PLS_LEVEL_SLOTS{};
 unsigned char PLS_DATA[0x8000];
 unsigned char PLS_POINTERS[0x8000];
 // index into both PLS_DATA and PLS_POINTERS
@@ -109,6 +129,12 @@ std::vector<memoryfile> g_memory_files{};
 patchfile g_shared_patch{"shared.asm"};
 patchfile g_shared_inscrc_patch{"shared_incsrc.asm"};
 std::vector<definedata> g_config_defines{};
+// shared routine names in the order of their pointers at $03E05C
+std::vector<std::string> g_routine_names{};
+// shared routines inserted during this run, for the insertion manifest
+std::map<std::string, inserted_routine> g_inserted_routines{};
+// labels of every asar invocation of this run, for --symbols and --symbols-index
+symbol_collector g_symbols{};
 
 struct addtempfile {
     const memoryfile& m_memory_file;
@@ -154,7 +180,7 @@ struct AsarHandler {
             .buflen = 0, .romlen = &size, .includepaths = nullptr, .numincludepaths = 0, .should_reset = true,
             .additional_defines = nullptr, .additional_define_count = 0, .stdincludesfile = nullptr,
             .stddefinesfile = nullptr, .warning_settings = nullptr, .warning_setting_count = 0, .memory_files = &file,
-            .memory_file_count = 1, .override_checksum_gen = false, .generate_checksum = true
+            .memory_file_count = 1, .override_checksum_gen = true, .generate_checksum = false
         };
         if (!asar_patch_ex(&params)) {
             io.error(
@@ -190,39 +216,301 @@ struct AsarHandler {
 };
 #endif
 
-void clean_sprite_generic(patchfile& clean_patch, int table_address, int original_value, size_t count,
-                          const char* preface, ROM& rom) {
-    clean_patch.fprintf("%s", preface);
-    int table = rom.pointer_snes(table_address).addr();
-    if (table != original_value) // check with default/uninserted address
-        for (size_t i = 0; i < count; i++) {
-            pointer pointer = rom.pointer_snes(table + 3 * static_cast<int>(i));
-            if (!pointer.is_empty())
-                clean_patch.fprintf("autoclean $%06X\n", pointer.addr());
+// how many entries the table of a misc sprite type gets, the asm hijacks ignore the sprite numbers past it
+size_t misc_table_count(ListType type, const sprite* list) {
+    if (cfg.MiscCapacities[FromEnum(type)] != 0)
+        return cfg.MiscCapacities[FromEnum(type)];
+    for (size_t i = SPRITE_COUNT; i > 0; i--) {
+        if (!list[i - 1].table.main.is_empty() || !list[i - 1].extended_cape_ptr.is_empty())
+            return i;
+    }
+    return 1;
+}
+
+[[nodiscard]] patchfile write_sprite_generic(const sprite* list, size_t count, const char* filename) {
+    // the $FFFFFF after the last entry tells the cleanup where the table ends
+    std::vector<unsigned char> file((count + 1) * 3, 0xFF);
+    for (size_t i = 0; i < count; i++)
+        memcpy(file.data() + (i * 3), &list[i].table.main, 3);
+    return write_all(file.data(), cfg[PathType::Asm], filename, static_cast<unsigned int>(file.size()));
+}
+
+// parses --misc-capacity, a comma separated list of type=count with the count in hex, like "cluster=20,score=8"
+[[nodiscard]] bool parse_misc_capacities(std::string_view spec) {
+    while (!spec.empty()) {
+        const size_t comma = spec.find(',');
+        const std::string_view entry = spec.substr(0, comma);
+        spec = comma == std::string_view::npos ? std::string_view{} : spec.substr(comma + 1);
+        const size_t equals = entry.find('=');
+        const std::string_view name = entry.substr(0, equals);
+        auto it = std::find_if(misc_type_names.begin() + 1, misc_type_names.end(), [name](std::string_view type) {
+            return std::equal(type.begin(), type.end(), name.begin(), name.end(),
+                              [](char a, char b) { return tolower(a) == tolower(b); });
+        });
+        unsigned int count = 0;
+        int read_until = -1;
+        const std::string value{equals == std::string_view::npos ? std::string_view{} : entry.substr(equals + 1)};
+        if (it == misc_type_names.end() || sscanf(value.c_str(), "%x%n", &count, &read_until) != 1 ||
+            read_until != static_cast<int>(value.size()) || count == 0 || count > SPRITE_COUNT) {
+            io.error("Invalid --misc-capacity entry \"%s\", it should be TYPE=COUNT with COUNT in hex from 1 to %X "
+                     "and TYPE one of extended, cluster, minorextended, bounce, smoke, spinningcoin, score\n",
+                     std::string{entry}.c_str(), static_cast<unsigned int>(SPRITE_COUNT));
+            return false;
         }
+        cfg.MiscCapacities[static_cast<size_t>(it - misc_type_names.begin())] = count;
+    }
+    return true;
 }
 
-template <size_t COUNT> [[nodiscard]] patchfile write_sprite_generic(sprite (&list)[COUNT], const char* filename) {
-    unsigned char file[COUNT * 3]{};
-    for (size_t i = 0; i < COUNT; i++)
-        memcpy(file + (i * 3), &list[i].table.main, 3);
-    return write_all(file, cfg[PathType::Asm], filename, COUNT * 3);
+// where the normal sprites of list.txt go: global sprites by number, per-level sprites in the next free entry
+// before the global ones, found again through their level and number
+class normal_sprite_slots {
+    sprite* m_table;
+    std::unordered_map<int, size_t> m_per_level{}; // (level << 8) | number -> index in m_table
+    size_t m_next = 0;
+
+  public:
+    explicit normal_sprite_slots(sprite* table) : m_table{table} {
+    }
+    // nullptr if there's no room left for another per-level sprite
+    sprite* get(int level, int number) {
+        if (!cfg.PerLevel)
+            return m_table + number;
+        if (level == 0x200)
+            return m_table + (PER_LEVEL_SPRITE_COUNT + number);
+        auto [it, added] = m_per_level.try_emplace((level << 8) | number, m_next);
+        if (added) {
+            if (m_next == PER_LEVEL_SPRITE_COUNT) {
+                m_per_level.erase(it);
+                return nullptr;
+            }
+            m_next++;
+        }
+        return m_table + it->second;
+    }
+};
+
+bool is_per_level(const sprite* spr) {
+    return spr->sprite_type == ListType::Sprite && spr->level < 0x200;
 }
 
-template <typename T> T* from_table(T* table, int level, int number) {
-    if (!cfg.PerLevel)
-        return table + number;
+// with --stable-placement the freespace blocks of the previous run's global and misc sprites survive the cleanup when
+// their slot gets a sprite again (the other ones are cleaned right away so their space can be used during insertion),
+// each sprite is assembled back in the block of its slot when it still fits and the blocks that turned out too small
+// are cleaned once every sprite has been inserted
+class stable_placement {
+  public:
+    struct block {
+        int start; // snes address right after the RATS tag
+        int size;
+        bool reused = false;
+    };
 
-    if (level > 0x200 || number > 0xFF)
-        return nullptr;
-    if (level == 0x200)
-        return table + (0x2000 + number);
-    else if (number >= 0xB0 && number < 0xC0)
-        return table + ((level * 0x10) + (number - 0xB0));
-    return nullptr;
+  private:
+    std::vector<block> m_blocks{};
+    std::unordered_map<int, size_t> m_slots{}; // (list type << 8) | number -> index in m_blocks
+
+    // RATS blocks found so far and addresses that aren't in one, the cleanup looks up every pointer of the rom and
+    // each search can go back 64KB
+    mutable std::vector<block> m_found{};
+    mutable std::unordered_set<int> m_outside{};
+
+    // same search asar does for autoclean: the closest RATS tag before the address that covers it
+    static std::optional<block> scan_block(const ROM& rom, int address) {
+        const int pc = rom.snes_to_pc(address, false);
+        if (pc < 0 || pc >= rom.size)
+            return std::nullopt;
+        for (int tag = pc - 8; tag >= std::max(0, pc - 0x10000); tag--) {
+            const unsigned char* bytes = rom.real_data + tag;
+            if (memcmp(bytes, "STAR", 4) != 0 || (bytes[4] ^ bytes[6]) != 0xFF || (bytes[5] ^ bytes[7]) != 0xFF)
+                continue;
+            const int size = (bytes[4] | (bytes[5] << 8)) + 1;
+            if (tag + 8 + size <= pc)
+                return std::nullopt;
+            return block{rom.pc_to_snes(tag + 8, false), size};
+        }
+        return std::nullopt;
+    }
+
+    std::optional<block> find_block(const ROM& rom, int address) const {
+        const auto known = std::find_if(m_found.begin(), m_found.end(), [address](const block& b) {
+            return address >= b.start && address < b.start + b.size;
+        });
+        if (known != m_found.end())
+            return block{known->start, known->size};
+        if (m_outside.contains(address))
+            return std::nullopt;
+        const std::optional<block> found = scan_block(rom, address);
+        if (found)
+            m_found.push_back(*found);
+        else
+            m_outside.insert(address);
+        return found;
+    }
+
+  public:
+    static int slot_key(ListType type, int number) {
+        return (FromEnum(type) << 8) | number;
+    }
+
+    void clear() {
+        m_blocks.clear();
+        m_slots.clear();
+        m_found.clear();
+        m_outside.clear();
+    }
+
+    void add_slot(const ROM& rom, ListType type, int number, pointer ptr) {
+        if (ptr.is_empty() || ptr.addr() == 0xFFFFFF)
+            return;
+        const std::optional<block> found = find_block(rom, ptr.addr());
+        if (!found)
+            return;
+        auto it = std::find_if(m_blocks.begin(), m_blocks.end(),
+                               [&found](const block& known) { return known.start == found->start; });
+        if (it == m_blocks.end())
+            it = m_blocks.insert(m_blocks.end(), *found);
+        m_slots.try_emplace(slot_key(type, number), static_cast<size_t>(it - m_blocks.begin()));
+    }
+
+    // whether the cleanup has to leave the block this address is in alone
+    [[nodiscard]] bool keeps(const ROM& rom, int address) const {
+        if (m_blocks.empty())
+            return false;
+        const std::optional<block> found = find_block(rom, address);
+        return found && std::any_of(m_blocks.begin(), m_blocks.end(),
+                                    [&found](const block& known) { return known.start == found->start; });
+    }
+
+    // the block the previous sprite of this slot was in, nullptr if there's none or another sprite reused it already
+    [[nodiscard]] block* find(ListType type, int number) {
+        auto it = m_slots.find(slot_key(type, number));
+        if (it == m_slots.end() || m_blocks[it->second].reused)
+            return nullptr;
+        return &m_blocks[it->second];
+    }
+
+    [[nodiscard]] bool clean_unused(ROM& rom);
+};
+stable_placement g_stable_placement{};
+
+// where the hijacks keep the pointer to each misc sprite table, the value that's there before pixi is applied and
+// the table size of the versions that didn't end the tables with $FFFFFF
+struct misc_table_location {
+    ListType type;
+    int table_address;
+    int original_value;
+    size_t legacy_count;
+};
+constexpr misc_table_location MISC_TABLES[]{
+    {ListType::Cluster, 0x00A68A, 0x9C1498, SPRITE_COUNT},
+    {ListType::Extended, 0x029B1F, 0x176FBC, SPRITE_COUNT},
+    {ListType::MinorExtended, 0x028B70, 0x942016, LESS_SPRITE_COUNT},
+    {ListType::Bounce, 0x029058, 0x03F016, LESS_SPRITE_COUNT},
+    {ListType::Smoke, 0x0296C4, 0x7F2912, LESS_SPRITE_COUNT},
+    {ListType::SpinningCoin, 0x0299D8, 0x2003F0, MINOR_SPRITE_COUNT},
+    {ListType::Score, 0x02ADBE, 0xF016E1, MINOR_SPRITE_COUNT},
+};
+
+// terminated tables end with $FFFFFF, they can then hold up to SPRITE_COUNT entries
+template <typename F> void for_each_misc_pointer(const misc_table_location& location, bool terminated, const ROM& rom,
+                                                 F&& callback) {
+    int table = rom.pointer_snes(location.table_address).addr();
+    if (table == location.original_value) // check with default/uninserted address
+        return;
+    const size_t count = terminated ? SPRITE_COUNT : location.legacy_count;
+    for (size_t i = 0; i < count; i++) {
+        pointer pointer = rom.pointer_snes(table + 3 * static_cast<int>(i));
+        if (terminated && pointer.addr() == 0xFFFFFF)
+            break;
+        callback(static_cast<int>(i), pointer);
+    }
+}
+
+void clean_sprite_generic(patchfile& clean_patch, const misc_table_location& location, bool terminated, ROM& rom) {
+    clean_patch.fprintf("\n\n;%s:\n", std::string{misc_type_names[FromEnum(location.type)]}.c_str());
+    for_each_misc_pointer(location, terminated, rom, [&](int, pointer pointer) {
+        if (!pointer.is_empty() && !g_stable_placement.keeps(rom, pointer.addr()))
+            clean_patch.fprintf("autoclean $%06X\n", pointer.addr());
+    });
 }
 
-[[nodiscard]] bool patch(const patchfile& file, ROM& rom) {
+// copies the tables of a per-level sprite after the ones already added, build_per_level_blocks() then points
+// its level's block to them
+[[nodiscard]] bool add_per_level_sprite(const sprite* spr) {
+    if (PLS_DATA_ADDR >= 0x8000) {
+        io.error("Too many Per-Level sprites.  Please remove some.\n");
+        return false;
+    }
+    std::vector<int>& slots = PLS_LEVEL_SLOTS[spr->level];
+    const size_t slot = static_cast<size_t>(spr->number - cfg.PerLevelSlots.first);
+    if (slots.size() <= slot)
+        slots.resize(slot + 1);
+    slots[slot] = PLS_DATA_ADDR + 1;
+
+    memcpy(PLS_DATA + PLS_DATA_ADDR, &spr->table, 0x10);
+    memcpy(PLS_POINTERS + PLS_DATA_ADDR, &spr->ptrs, 15);
+    PLS_POINTERS[PLS_DATA_ADDR + 0x0F] = 0xFF;
+    PLS_DATA_ADDR += 0x10;
+    return true;
+}
+
+// each level with per-level sprites gets a block in PLS_SPRITE_PTRS made of the size of its slots, that is
+// (highest number it uses - first per-level number + 1) * 2, followed by the pointers of those slots, see
+// GetPerLevelAddr in main.asm.
+// PLS_LEVEL_PTRS holds the offset of the block + 1 for every level, 0 for the levels without one.
+[[nodiscard]] bool build_per_level_blocks() {
+    auto put_word = [](unsigned char* table, int offset, int value) {
+        table[offset] = static_cast<unsigned char>(value);
+        table[offset + 1] = static_cast<unsigned char>(value >> 8);
+    };
+    for (const auto& [level, slots] : PLS_LEVEL_SLOTS) {
+        const int block_size = 2 + static_cast<int>(slots.size()) * 2;
+        if (PLS_SPRITE_PTRS_ADDR + block_size > static_cast<int>(sizeof(PLS_SPRITE_PTRS))) {
+            io.error("The per-level sprite pointers don't fit in a bank, use lower sprite numbers or fewer levels for "
+                     "per-level sprites\n");
+            return false;
+        }
+        put_word(PLS_LEVEL_PTRS, level * 2, PLS_SPRITE_PTRS_ADDR + 1);
+        put_word(PLS_SPRITE_PTRS, PLS_SPRITE_PTRS_ADDR, static_cast<int>(slots.size()) * 2);
+        for (size_t i = 0; i < slots.size(); i++)
+            put_word(PLS_SPRITE_PTRS, PLS_SPRITE_PTRS_ADDR + 2 + static_cast<int>(i) * 2, slots[i]);
+        PLS_SPRITE_PTRS_ADDR += block_size;
+    }
+    return true;
+}
+
+bool symbols_requested() {
+    return !cfg.SymbolsType.empty() || !cfg.SymbolsIndexFile.empty();
+}
+
+constexpr std::string_view CORE_NAMESPACE = "PIXI_CORE_";
+
+// the combined core patch puts each file in a PIXI_CORE_<n> namespace, its labels are named as they'd be without it
+std::string_view without_core_namespace(std::string_view name) {
+    if (!name.starts_with(CORE_NAMESPACE))
+        return name;
+    size_t end = CORE_NAMESPACE.size();
+    while (end < name.size() && std::isdigit(static_cast<unsigned char>(name[end])))
+        end++;
+    if (end == CORE_NAMESPACE.size() || end >= name.size() || name[end] != '_')
+        return name;
+    return name.substr(end + 1);
+}
+
+// adds the labels of the last asar invocation to the merged symbols
+void collect_symbols() {
+    if (!symbols_requested())
+        return;
+    int label_count = 0;
+    const labeldata* labels = asar_getalllabels(&label_count);
+    for (int i = 0; i < label_count; i++)
+        g_symbols.add(without_core_namespace(labels[i].name), labels[i].location);
+}
+
+// report_errors = false leaves asar's errors to the caller, for patches that can be retried another way
+// collect_labels = false leaves the labels to the caller too, see collect_sprite_symbols
+[[nodiscard]] bool patch(const patchfile& file, ROM& rom, bool report_errors = true, bool collect_labels = true) {
     // clang-format off
     constexpr struct warnsetting disabled_warnings[] {
         {.warnid = "Wrelative_path_used", .enabled = false},
@@ -233,7 +521,7 @@ template <typename T> T* from_table(T* table, int level, int number) {
     struct patchparams params {
         .structsize = sizeof(struct patchparams), 
         .patchloc = file.path().c_str(),
-        .romdata = reinterpret_cast<char*>(rom.real_data),
+        .romdata = rom.asar_buffer(),
         .buflen = MAX_ROM_SIZE,
         .romlen = &rom.size, 
         .includepaths = nullptr,
@@ -247,11 +535,13 @@ template <typename T> T* from_table(T* table, int level, int number) {
         .warning_setting_count = static_cast<int>(array_size(disabled_warnings)),
         .memory_files = g_memory_files.data(),
         .memory_file_count = memfiles_size,
-        .override_checksum_gen = false,
-        .generate_checksum = true
+        .override_checksum_gen = true, // the checksum is fixed once before the rom is written
+        .generate_checksum = false
     };
     // clang-format on
     if (!asar_patch_ex(&params)) {
+        if (!report_errors)
+            return false;
         int error_count;
         const errordata* errors = asar_geterrors(&error_count);
         io.error("An error has been detected while applying patch %s:\n", file.path().c_str());
@@ -268,19 +558,27 @@ template <typename T> T* from_table(T* table, int level, int number) {
     for (int i = 0; i < print_count; i++)
         io.debug("Asar print from %s: %s\n", file.path().c_str(), asar_prints[i]);
 
-    if (!cfg.SymbolsType.empty()) {
-        const char* symbols_contents = asar_getsymbolsfile(cfg.SymbolsType.c_str());
-        std::string symbols_path{fs::path{file.path()}.replace_extension(cfg.SymbolsType).generic_string()};
-        FILE* wla = open(symbols_path.c_str(), "w");
-        if (wla) {
-            fwrite(symbols_contents, 1, strlen(symbols_contents), wla);
-            fclose(wla);
-        }
-    }
+    if (collect_labels)
+        collect_symbols();
 
     return true;
 }
 
+bool stable_placement::clean_unused(ROM& rom) {
+    const auto unused = std::count_if(m_blocks.begin(), m_blocks.end(), [](const block& b) { return !b.reused; });
+    io.debug("Stable placement: %zu of %zu previous blocks reused\n", m_blocks.size() - static_cast<size_t>(unused),
+             m_blocks.size());
+    if (unused == 0)
+        return true;
+    patchfile clean_patch{cfg.AsmDir + "_stablecleanup.asm"};
+    for (const block& b : m_blocks) {
+        if (!b.reused)
+            clean_patch.fprintf("autoclean $%06X\n", b.start);
+    }
+    clean_patch.close();
+    return patch(clean_patch, rom);
+}
+
 [[nodiscard]] bool patch(const char* patch_name_rel, ROM& rom) {
     std::string patch_path{patch_name_rel}; //  = std::filesystem::absolute(patch_name_rel).generic_string();
     // clang-format off
@@ -291,7 +589,7 @@ template <typename T> T* from_table(T* table, int level, int number) {
     patchparams params {
         .structsize = sizeof(patchparams), 
         .patchloc = patch_path.c_str(),
-        .romdata = reinterpret_cast<char*>(rom.real_data),
+        .romdata = rom.asar_buffer(),
         .buflen = MAX_ROM_SIZE,
         .romlen = &rom.size, 
         .includepaths = nullptr,
@@ -305,8 +603,8 @@ template <typename T> T* from_table(T* table, int level, int number) {
         .warning_setting_count = static_cast<int>(array_size(disabled_warnings)),
         .memory_files = g_memory_files.data(),
         .memory_file_count = static_cast<int>(g_memory_files.size()),
-        .override_checksum_gen = false,
-        .generate_checksum = true
+        .override_checksum_gen = true,
+        .generate_checksum = false
     };
     // clang-format on
     if (!asar_patch_ex(&params)) {
@@ -322,15 +620,7 @@ template <typename T> T* from_table(T* table, int level, int number) {
     for (int i = 0; i < warn_count; i++)
         warnings.emplace_back(loc_warnings[i].fullerrdata);
 
-    if (!cfg.SymbolsType.empty()) {
-        const char* symbols_contents = asar_getsymbolsfile(cfg.SymbolsType.c_str());
-        std::string symbols_path{fs::path{patch_name_rel}.replace_extension(cfg.SymbolsType).generic_string()};
-        FILE* wla = open(symbols_path.c_str(), "w");
-        if (wla) {
-            fwrite(symbols_contents, 1, strlen(symbols_contents), wla);
-            fclose(wla);
-        }
-    }
+    collect_symbols();
 
     int print_count = 0;
     const char* const* asar_prints = asar_getprints(&print_count);
@@ -352,40 +642,24 @@ void addIncScrToFile(patchfile& file, const std::vector<std::string>& toInclude)
     }
 }
 
-constexpr bool ends_with(const char* str, const char* suffix) {
-    if (str == nullptr || suffix == nullptr)
-        return false;
-    std::string_view strv{str};
-    std::string_view suffixv{str};
-    return strv.ends_with(suffixv);
-}
-
-[[nodiscard]] bool create_lm_restore(const char* rom) {
+[[nodiscard]] bool create_lm_restore(const char* rom, output_transaction& outputs) {
     char to_write[50];
     sprintf(to_write, "Pixi v%d.%d\t", VERSION_MAJOR, VERSION_PARTIAL);
     std::string romname(rom);
     std::string restorename = romname.substr(0, romname.find_last_of('.')) + ".extmod";
 
-    FILE* res = open(restorename.c_str(), "a+");
-    if (res) {
-        size_t size = file_size(res);
-        auto contents = std::make_unique<char[]>(size + 1);
-        size_t read_size = fread(contents.get(), 1, size, res);
-        if (size != read_size) {
-            io.error("Couldn't fully read file %s, please check file permissions", restorename.c_str());
-            return false;
-        }
-        contents[size] = '\0';
-        if (!ends_with(contents.get(), to_write)) {
-            fseek(res, 0, SEEK_END);
-            fprintf(res, "%s", to_write);
-        }
-        fclose(res);
-        return true;
-    } else {
-        io.error("Couldn't open restore file for writing (%s)\n", restorename.c_str());
+    file_buffer contents{};
+    if (fs::exists(restorename) && !contents.open(restorename)) {
+        io.error("Couldn't fully read file %s, please check file permissions", restorename.c_str());
         return false;
     }
+    if (contents.view().ends_with(to_write))
+        return true;
+    // binary since the existing contents are copied as they were read, line endings included
+    file_writer& res = outputs.add(restorename);
+    res.write(contents.view());
+    res.write(to_write);
+    return true;
 }
 
 std::string escapeDefines(std::string_view path, const char* repl = "\\!") {
@@ -400,6 +674,132 @@ std::string escapeDefines(std::string_view path, const char* repl = "\\!") {
     return ss.str();
 }
 
+// inlined routine calls print their name and expanded size, sum them up per routine to show what inlining cost and saved
+void report_inlined_routines(const sprite* spr, std::span<const std::string> prints) {
+    struct inline_usage {
+        int count = 0;
+        int bytes = 0;
+    };
+    std::map<std::string, inline_usage> usages{};
+    for (const auto& print : prints) {
+        if (!print.starts_with(INLINE_PRINT_TAG))
+            continue;
+        std::istringstream fields{print.substr(INLINE_PRINT_TAG.size())};
+        std::string name{};
+        int bytes = 0;
+        if (fields >> name >> bytes) {
+            auto& usage = usages[name];
+            usage.count++;
+            usage.bytes += bytes;
+        }
+    }
+    for (const auto& [name, usage] : usages) {
+        io.print("%s: %s inlined %d time(s), %d bytes instead of %d bytes of JSL, %d cycles saved per call\n",
+                 spr->asm_file.c_str(), name.c_str(), usage.count, usage.bytes, usage.count * INLINE_JSL_SIZE,
+                 INLINE_SAVED_CYCLES);
+    }
+}
+
+// printed after each sprite's code with the address of its entry label and the pc at the end of its file
+constexpr std::string_view SPRITE_SIZE_PRINT_TAG = "__PIXI_INTERNAL_SIZE__";
+// printed by the shared routine macros on every JSL to the routine
+constexpr std::string_view ROUTINE_CALL_PRINT_TAG = "__PIXI_INTERNAL_ROUTINE__";
+// printed when a routine gets inserted, with its address and the pc after it
+constexpr std::string_view ROUTINE_SIZE_PRINT_TAG = "__PIXI_INTERNAL_ROUTINE_SIZE__";
+
+// the distance between two addresses is only a size if both are in the same freespace block, which can't be known
+// from asar, so it's only trusted when they're in the same bank and in order
+int block_size(int start, int end) {
+    if (end < start || (start >> 16) != (end >> 16))
+        return -1;
+    return end - start;
+}
+
+// fills in the size of the sprite and the routines it uses for the insertion manifest
+void collect_insertion_info(sprite* spr, std::span<const std::string> prints) {
+    for (const auto& print : prints) {
+        std::string_view tag{};
+        for (std::string_view candidate : {SPRITE_SIZE_PRINT_TAG, ROUTINE_CALL_PRINT_TAG, INLINE_PRINT_TAG}) {
+            if (print.starts_with(candidate) && print.size() > candidate.size() && print[candidate.size()] == ' ')
+                tag = candidate;
+        }
+        if (tag.empty())
+            continue;
+        std::istringstream fields{print.substr(tag.size())};
+        if (tag == SPRITE_SIZE_PRINT_TAG) {
+            int start = 0;
+            int end = 0;
+            if (fields >> std::hex >> start >> end)
+                spr->insert_size = block_size(start, end);
+        } else {
+            std::string name{};
+            if (fields >> name && std::find(spr->routines.begin(), spr->routines.end(), name) == spr->routines.end())
+                spr->routines.push_back(std::move(name));
+        }
+    }
+}
+
+// the labels inside the code a sprite inserted get its list and slot in front of them (Sprite_1A_Graphics, or
+// Sprite_105_B0_Graphics for a per-level sprite) since every sprite has the same local names and they all end up in
+// one symbols file, the other labels of the patch (shared routines, shared.asm, _header.asm) are kept as they are
+void collect_sprite_symbols(const sprite* spr, std::span<const std::string> prints, std::span<const labeldata> labels) {
+    if (!symbols_requested())
+        return;
+    int start = 0;
+    int end = 0;
+    for (const auto& print : prints) {
+        if (print.starts_with(SPRITE_SIZE_PRINT_TAG)) {
+            std::istringstream fields{print.substr(SPRITE_SIZE_PRINT_TAG.size())};
+            fields >> std::hex >> start >> end;
+        }
+    }
+    const char* list_name = misc_type_names[FromEnum(spr->sprite_type)].data();
+    const std::string scope = is_per_level(spr) ? fstring("%s_%03X_%02X_", list_name, spr->level, spr->number)
+                                                : fstring("%s_%02X_", list_name, spr->number);
+    for (const labeldata& label : labels) {
+        if (label.location >= start && label.location < end)
+            g_symbols.add(scope + label.name, label.location);
+        else
+            g_symbols.add(label.name, label.location);
+    }
+}
+
+void collect_inserted_routines(std::span<const std::string> prints) {
+    for (const auto& print : prints) {
+        if (!print.starts_with(ROUTINE_SIZE_PRINT_TAG))
+            continue;
+        std::istringstream fields{print.substr(ROUTINE_SIZE_PRINT_TAG.size())};
+        std::string name{};
+        int start = 0;
+        int end = 0;
+        if (fields >> name >> std::hex >> start >> end)
+            g_inserted_routines[name] = {start, block_size(start, end)};
+    }
+}
+
+// on fastrom roms the code pointers are moved to the $80+ mirror of their bank, so that the JML/JSL into them runs
+// at 3.58MHz instead of 2.68MHz. Empty pointers are left alone since cleanup relies on them being $018021.
+void mirror_pointers_to_fastrom(sprite* spr) {
+    if (!cfg.FastRom)
+        return;
+    auto mirror = [](pointer& ptr) {
+        if (ptr.is_empty() || ptr.addr() == 0x000000 || (ptr.bankbyte & 0x7F) >= 0x7E)
+            return;
+        ptr.bankbyte |= 0x80;
+    };
+    mirror(spr->table.init);
+    mirror(spr->table.main);
+    if (spr->sprite_type == ListType::Extended) {
+        mirror(spr->extended_cape_ptr);
+    } else if (spr->sprite_type == ListType::Sprite) {
+        mirror(spr->ptrs.carried);
+        mirror(spr->ptrs.carriable);
+        mirror(spr->ptrs.kicked);
+        mirror(spr->ptrs.mouth);
+        mirror(spr->ptrs.goal);
+    }
+}
+
 static bool strccmp(std::string_view first, std::string_view second) {
     if (first.size() != second.size())
         return false;
@@ -412,13 +812,13 @@ static bool strccmp(std::string_view first, std::string_view second) {
     std::string escapedAsmdir = escapeDefines(cfg.AsmDir);
     patchfile sprite_patch{TEMP_SPR_FILE};
 
-    const char prelude[] = R"(namespace nested on
+    static constexpr char prelude[] = R"(namespace nested on
 warnings push
 warnings disable Wrelative_path_used
 warnings disable W65816_xx_y_assume_16_bit
 incsrc "%ssa1def.asm"
 )";
-    const char epilogue[] = R"(incsrc "shared.asm"
+    static constexpr char epilogue[] = R"(incsrc "shared.asm"
 incsrc "%s_header.asm"
 )";
     sprite_patch.fprintf(prelude, escapedAsmdir.c_str());
@@ -428,7 +828,7 @@ incsrc "%s_header.asm"
 }
 
 void add_epilogue_to_sprite_patch(patchfile& sprite_patch) {
-    const char epilogue[] = R"(incsrc "shared_incsrc.asm"
+    static constexpr char epilogue[] = R"(incsrc "shared_incsrc.asm"
 warnings pull
 namespace nested off
 )";
@@ -438,54 +838,67 @@ namespace nested off
 
 void add_sprite_to_patch(patchfile& sprite_patch, sprite* spr) {
     std::string escapedAsmfile = escapeDefines(spr->asm_file);
-    const char patchstr[] = R"(freecode cleaned
+    static constexpr char patchstr[] = R"(freecode cleaned
 namespace SPRITE_ENTRY_%d
 SPRITE_ENTRY_%d:
     incsrc "%s"
+print "%s ", hex(SPRITE_ENTRY_%d), " ", hex(pc())
 namespace off
 print "__PIXI_INTERNAL_SPRITE_SEPARATOR__"
 )";
-    sprite_patch.fprintf(patchstr, spr->number, spr->number, escapedAsmfile.c_str());
+    sprite_patch.fprintf(patchstr, spr->number, spr->number, escapedAsmfile.c_str(), SPRITE_SIZE_PRINT_TAG.data(),
+                         spr->number);
 }
 
 [[nodiscard]] bool patch_sprite(const std::vector<std::string>& extraDefines, sprite* spr, ROM& rom) {
     std::string escapedDir = escapeDefines(spr->directory);
     std::string escapedAsmfile = escapeDefines(spr->asm_file);
     std::string escapedAsmdir = escapeDefines(cfg.AsmDir);
-    patchfile sprite_patch{TEMP_SPR_FILE};
-    const char prefix[] = R"(namespace nested on
+    static constexpr char prefix[] = R"(namespace nested on
 warnings push
 warnings disable Wrelative_path_used
 warnings disable W65816_xx_y_assume_16_bit
 incsrc "%ssa1def.asm"
 )";
-    const char postfix[] = R"(incsrc "shared.asm"
+    static constexpr char postfix[] = R"(incsrc "shared.asm"
 incsrc "%s_header.asm"
-freecode cleaned
+%s
 SPRITE_ENTRY_%d:
     incsrc "%s"
+print "%s ", hex(SPRITE_ENTRY_%d), " ", hex(pc())
+%s
 incsrc "shared_incsrc.asm"
 warnings pull
 namespace nested off
 )";
-    sprite_patch.fprintf(prefix, escapedAsmdir.c_str());
-    addIncScrToFile(sprite_patch, extraDefines);
-    sprite_patch.fprintf(postfix, escapedDir.c_str(), spr->number, escapedAsmfile.c_str());
-    sprite_patch.close();
-
-    if (!patch(sprite_patch, rom))
-        return false;
+    auto write_patch = [&](patchfile& sprite_patch, const std::string& placement, const std::string& bound) {
+        sprite_patch.fprintf(prefix, escapedAsmdir.c_str());
+        addIncScrToFile(sprite_patch, extraDefines);
+        sprite_patch.fprintf(postfix, escapedDir.c_str(), placement.c_str(), spr->number, escapedAsmfile.c_str(),
+                             SPRITE_SIZE_PRINT_TAG.data(), spr->number, bound.c_str());
+        sprite_patch.close();
+    };
 
-    if (!cfg.SymbolsType.empty()) {
-        fs::path symbols_to_file = fs::path{spr->asm_file}.replace_extension(cfg.SymbolsType);
-        fs::path symbols_from_file = fs::path{TEMP_SPR_FILE}.replace_extension(cfg.SymbolsType);
-        try {
-            fs::rename(symbols_from_file, symbols_to_file);
-        } catch (const fs::filesystem_error& err) {
-            io.error("Trying to rename symbol file of \"%s\" returned \"%s\", aborting insertion\n",
-                     spr->asm_file.c_str(), err.what());
+    stable_placement::block* previous =
+        cfg.StablePlacement && !is_per_level(spr) ? g_stable_placement.find(spr->sprite_type, spr->number) : nullptr;
+    bool placed = false;
+    if (previous != nullptr) {
+        // the RATS tag of the block is still there, the sprite just has to end before it does
+        patchfile sprite_patch{TEMP_SPR_FILE};
+        write_patch(sprite_patch, fstring("org $%06X", previous->start),
+                    fstring("warnpc $%06X", previous->start + previous->size));
+        placed = patch(sprite_patch, rom, false, false);
+        if (placed)
+            previous->reused = true;
+        else
+            io.debug("%s doesn't fit in its previous block at $%06X anymore, moving it\n", spr->asm_file.c_str(),
+                     previous->start);
+    }
+    if (!placed) {
+        patchfile sprite_patch{TEMP_SPR_FILE};
+        write_patch(sprite_patch, "freecode cleaned", "");
+        if (!patch(sprite_patch, rom, true, false))
             return false;
-        }
     }
 
     using ptr_map_t = std::unordered_map<std::string_view, pointer>;
@@ -513,6 +926,10 @@ namespace nested off
     io.debug("%s\n", spr->asm_file.c_str());
     if (print_count > 2)
         io.debug("Prints:\n");
+    report_inlined_routines(spr, prints);
+    collect_insertion_info(spr, prints);
+    collect_inserted_routines(prints);
+    collect_sprite_symbols(spr, prints, labels);
 
     using namespace std::string_view_literals;
 
@@ -560,7 +977,7 @@ namespace nested off
                 ptr_map[ch.name] = strtol(prints[i].c_str() + ch.name.size(), nullptr, 16);
             }
 
-        } else {
+        } else if (!prints[i].starts_with("__PIXI_INTERNAL_")) {
             io.debug("\t%s\n", prints[i].c_str());
         }
     }
@@ -596,6 +1013,7 @@ namespace nested off
         spr->ptrs.mouth = ptr_map["MOUTH"];
         spr->ptrs.goal = ptr_map["GOAL"];
     }
+    mirror_pointers_to_fastrom(spr);
     if (spr->sprite_type == ListType::Sprite)
         io.debug("\tINIT: $%06X\n\tMAIN: $%06X\n"
                  "\tCARRIABLE: $%06X\n\tCARRIED: $%06X\n\tKICKED: $%06X\n"
@@ -615,6 +1033,8 @@ namespace nested off
 }
 
 bool fill_single_sprite(sprite* spr, std::span<std::string> prints) {
+    report_inlined_routines(spr, prints);
+    collect_insertion_info(spr, prints);
     using ptr_map_t = std::unordered_map<std::string_view, pointer>;
     using ptr_map_v_t = ptr_map_t::value_type;
     ptr_map_t ptr_map = {
@@ -667,7 +1087,7 @@ bool fill_single_sprite(sprite* spr, std::span<std::string> prints) {
                 ptr_map[ch.name] = strtol(prints[i].c_str() + ch.name.size(), nullptr, 16);
             }
 
-        } else {
+        } else if (!prints[i].starts_with("__PIXI_INTERNAL_")) {
             io.debug("\t%s\n", prints[i].c_str());
         }
     }
@@ -688,6 +1108,7 @@ bool fill_single_sprite(sprite* spr, std::span<std::string> prints) {
         spr->ptrs.mouth = ptr_map["MOUTH"];
         spr->ptrs.goal = ptr_map["GOAL"];
     }
+    mirror_pointers_to_fastrom(spr);
     if (spr->sprite_type == ListType::Sprite)
         io.debug("\tINIT: $%06X\n\tMAIN: $%06X\n"
                  "\tCARRIABLE: $%06X\n\tCARRIED: $%06X\n\tKICKED: $%06X\n"
@@ -704,36 +1125,8 @@ bool fill_single_sprite(sprite* spr, std::span<std::string> prints) {
                  "\n__________________________________\n",
                  spr->table.init.addr(), spr->table.main.addr());
 
-    if (spr->level < 0x200 && spr->number >= 0xB0 && spr->number < 0xC0) {
-        int pls_lv_addr = PLS_LEVEL_PTRS[spr->level * 2] + (PLS_LEVEL_PTRS[spr->level * 2 + 1] << 8);
-        if (pls_lv_addr == 0x0000) {
-            pls_lv_addr = PLS_SPRITE_PTRS_ADDR + 1;
-            PLS_LEVEL_PTRS[spr->level * 2] = (unsigned char)pls_lv_addr;
-            PLS_LEVEL_PTRS[spr->level * 2 + 1] = (unsigned char)(pls_lv_addr >> 8);
-            PLS_SPRITE_PTRS_ADDR += 0x20;
-        }
-        pls_lv_addr--;
-        pls_lv_addr += (spr->number - 0xB0) * 2;
-
-        if (PLS_DATA_ADDR >= 0x8000) {
-            io.error("Too many Per-Level sprites.  Please remove some.\n", "");
-            return false;
-        }
-
-        PLS_SPRITE_PTRS[pls_lv_addr] = (unsigned char)(PLS_DATA_ADDR + 1);
-        PLS_SPRITE_PTRS[pls_lv_addr + 1] = (unsigned char)((PLS_DATA_ADDR + 1) >> 8);
-
-        memcpy(PLS_DATA + PLS_DATA_ADDR, &spr->table, 0x10);
-        memcpy(PLS_POINTERS + PLS_DATA_ADDR, &spr->ptrs, 15);
-        int index = PLS_DATA_ADDR + 0x0F;
-        if (index < 0x8000) {
-            PLS_POINTERS[index] = 0xFF;
-        } else {
-            io.error("Per-level sprites data address out of bounds of array, value is %d", PLS_DATA_ADDR);
-            return false;
-        }
-        PLS_DATA_ADDR += 0x10;
-    }
+    if (is_per_level(spr))
+        return add_per_level_sprite(spr);
 
     return true;
 }
@@ -787,6 +1180,7 @@ bool fill_single_sprite(sprite* spr, std::span<std::string> prints) {
         labels.push_back(asar_labels[i]);
     }
 
+    collect_inserted_routines(prints);
     auto it = prints.begin();
     std::unordered_map<std::string_view, std::span<std::string>> sprite_prints{};
     constexpr auto separator = "__PIXI_INTERNAL_SPRITE_SEPARATOR__"sv;
@@ -834,6 +1228,8 @@ bool fill_single_sprite(sprite* spr, std::span<std::string> prints) {
                     spr->table.main = sprite_list[j].table.main;
                     spr->extended_cape_ptr = sprite_list[j].extended_cape_ptr;
                     spr->ptrs = sprite_list[j].ptrs;
+                    spr->insert_size = sprite_list[j].insert_size;
+                    spr->routines = sprite_list[j].routines;
                     duplicate = true;
                     break;
                 }
@@ -845,41 +1241,46 @@ bool fill_single_sprite(sprite* spr, std::span<std::string> prints) {
                 return false;
         }
 
-        if (spr->level < 0x200 && spr->number >= 0xB0 && spr->number < 0xC0) {
-            int pls_lv_addr = PLS_LEVEL_PTRS[spr->level * 2] + (PLS_LEVEL_PTRS[spr->level * 2 + 1] << 8);
-            if (pls_lv_addr == 0x0000) {
-                pls_lv_addr = PLS_SPRITE_PTRS_ADDR + 1;
-                PLS_LEVEL_PTRS[spr->level * 2] = (unsigned char)pls_lv_addr;
-                PLS_LEVEL_PTRS[spr->level * 2 + 1] = (unsigned char)(pls_lv_addr >> 8);
-                PLS_SPRITE_PTRS_ADDR += 0x20;
-            }
-            pls_lv_addr--;
-            pls_lv_addr += (spr->number - 0xB0) * 2;
-
-            if (PLS_DATA_ADDR >= 0x8000) {
-                io.error("Too many Per-Level sprites.  Please remove some.\n", "");
-                return false;
-            }
+        if (is_per_level(spr) && !add_per_level_sprite(spr))
+            return false;
+    }
+    return true;
+}
 
-            PLS_SPRITE_PTRS[pls_lv_addr] = (unsigned char)(PLS_DATA_ADDR + 1);
-            PLS_SPRITE_PTRS[pls_lv_addr + 1] = (unsigned char)((PLS_DATA_ADDR + 1) >> 8);
+// the blocks --stable-placement can reuse, they're found before the cleanup is written since per-level sprites and
+// custom status pointers can point in them too. Only the slots that get a sprite patched in this run keep their
+// block, a sprite that has the same file as an earlier one in its list shares its code (see patch_sprites)
+void find_stable_blocks(const ROM& rom, const sprite_lists_view& lists) {
+    std::unordered_set<int> patched_slots{};
+    for (const auto& list : lists) {
+        for (auto spr = list.begin(); spr != list.end(); ++spr) {
+            if (spr->asm_file.empty() || is_per_level(&*spr))
+                continue;
+            if (std::none_of(list.begin(), spr, [&spr](const sprite& other) { return other.asm_file == spr->asm_file; }))
+                patched_slots.insert(stable_placement::slot_key(spr->sprite_type, spr->number));
+        }
+    }
+    auto add_slot = [&](ListType type, int number, pointer ptr) {
+        if (patched_slots.contains(stable_placement::slot_key(type, number)))
+            g_stable_placement.add_slot(rom, type, number, ptr);
+    };
 
-            memcpy(PLS_DATA + PLS_DATA_ADDR, &spr->table, 0x10);
-            memcpy(PLS_POINTERS + PLS_DATA_ADDR, &spr->ptrs, 15);
-            int index = PLS_DATA_ADDR + 0x0F;
-            if (index < 0x8000) {
-                PLS_POINTERS[index] = 0xFF;
-            } else {
-                io.error("Per-level sprites data address out of bounds of array, value is %d", PLS_DATA_ADDR);
-                return false;
-            }
-            PLS_DATA_ADDR += 0x10;
+    const int global_table_address = rom.pointer_snes(0x02FFEE).addr();
+    if (rom.pointer_snes(global_table_address).addr() != 0xFFFFFF) {
+        for (int number = 0; number < 0x100; number++) {
+            const int entry = global_table_address + number * 0x10;
+            const pointer main_pointer = rom.pointer_snes(entry + 0x0B);
+            add_slot(ListType::Sprite, number, main_pointer.is_empty() ? rom.pointer_snes(entry + 0x08) : main_pointer);
         }
     }
-    return true;
+    for (const misc_table_location& location : MISC_TABLES) {
+        for_each_misc_pointer(location, true, rom,
+                              [&](int number, pointer ptr) { add_slot(location.type, number, ptr); });
+    }
 }
 
-[[nodiscard]] bool clean_hack(ROM& rom, std::string_view pathname) {
+[[nodiscard]] bool clean_hack(ROM& rom, std::string_view pathname, const sprite_lists_view& lists) {
+    g_stable_placement.clear();
     if (!strncmp((char*)rom.data + rom.snes_to_pc(0x02FFE2), "STSD", 4)) { // already installed load old tables
 
         std::string path = cfg.AsmDir + "_cleanup.asm";
@@ -887,14 +1288,47 @@ bool fill_single_sprite(sprite* spr, std::span<std::string> prints) {
 
         int version = rom.data[rom.snes_to_pc(0x02FFE6)];
         int flags = rom.data[rom.snes_to_pc(0x02FFE7)];
+        // bit 3 = the misc tables only go up to the highest slot in use and end with $FFFFFF, older roms are fully
+        // cleaned even with --stable-placement
+        const bool terminated = (flags & 0x08) != 0;
+        if (cfg.StablePlacement && terminated)
+            find_stable_blocks(rom, lists);
 
         bool per_level_sprites_inserted = ((flags & 0x01) == 1) || (version < 2);
 
         // bit 0 = per level sprites inserted
         if (per_level_sprites_inserted) {
             // remove per level sprites
-            // version 1.30+
-            if (version >= 30) {
+            // bit 2 = each level's block starts with the size of its slots, the pointers to the tables follow the level
+            // pointers
+            if (flags & 0x04) {
+                clean_patch.fprintf(";Per-Level sprites\n");
+                const int first_number = rom.data[rom.snes_to_pc(0x02FFE9)];
+                const int level_ptrs = rom.pointer_snes(0x02FFF1).addr();
+                const int sprite_ptrs = rom.pointer_snes(0x02FFF4).addr();
+                const int level_table = rom.pointer_snes(0x02FFF7).addr();
+                if (level_ptrs != 0xFFFFFF && sprite_ptrs != 0xFFFFFF && level_table != 0xFFFFFF) {
+                    for (int level = 0; level < 0x200; level++) {
+                        const int block_offset = rom.read_word(rom.snes_to_pc(level_ptrs + level * 2));
+                        if (block_offset == 0)
+                            continue;
+                        const int block = rom.snes_to_pc(sprite_ptrs + block_offset - 1);
+                        const int slot_count = rom.read_word(block) / 2;
+                        for (int slot = 0; slot < slot_count; slot++) {
+                            const int number = first_number + slot;
+                            const int data_offset = rom.read_word(block + 2 + slot * 2);
+                            if (data_offset == 0)
+                                continue;
+                            pointer main_pointer = rom.pointer_snes(level_table + data_offset - 1 + 0x0B);
+                            if (!main_pointer.is_empty() && main_pointer.addr() != 0xFFFFFF &&
+                                !g_stable_placement.keeps(rom, main_pointer.addr()))
+                                clean_patch.fprintf("autoclean $%06X\t;%03X:%02X\n", main_pointer.addr(), level,
+                                                    number);
+                        }
+                    }
+                }
+                // version 1.30+
+            } else if (version >= 30) {
                 clean_patch.fprintf(";Per-Level sprites\n");
                 int level_table_address = rom.pointer_snes(0x02FFF1).addr();
                 if (level_table_address != 0xFFFFFF && level_table_address != 0x000000) {
@@ -956,11 +1390,11 @@ bool fill_single_sprite(sprite* spr, std::span<std::string> prints) {
         if (rom.pointer_snes(global_table_address).addr() != 0xFFFFFF) {
             for (int table_offset = 0x08; table_offset < limit; table_offset += 0x10) {
                 pointer init_pointer = rom.pointer_snes(global_table_address + table_offset);
-                if (!init_pointer.is_empty()) {
+                if (!init_pointer.is_empty() && !g_stable_placement.keeps(rom, init_pointer.addr())) {
                     clean_patch.fprintf("autoclean $%06X\n", init_pointer.addr());
                 }
                 pointer main_pointer = rom.pointer_snes(global_table_address + table_offset + 3);
-                if (!main_pointer.is_empty()) {
+                if (!main_pointer.is_empty() && !g_stable_placement.keeps(rom, main_pointer.addr())) {
                     clean_patch.fprintf("autoclean $%06X\n", main_pointer.addr());
                 }
             }
@@ -969,10 +1403,12 @@ bool fill_single_sprite(sprite* spr, std::span<std::string> prints) {
         // remove global sprites' custom pointers
         clean_patch.fprintf(";Global sprite custom pointers: \n");
         int pointer_table_address = rom.pointer_snes(0x02FFFD).addr();
+        // bit 1 = custom status pointer table only covers the first N sprites, N is stored in the first reserved byte
+        const int status_table_size = (flags & 0x02) ? rom.data[rom.snes_to_pc(0x02FFE8)] * 15 : 0x100 * 15;
         if (pointer_table_address != 0xFFFFFF && rom.pointer_snes(pointer_table_address).addr() != 0xFFFFFF) {
-            for (int table_offset = 0; table_offset < 0x100 * 15; table_offset += 3) {
+            for (int table_offset = 0; table_offset < status_table_size; table_offset += 3) {
                 pointer ptr = rom.pointer_snes(pointer_table_address + table_offset);
-                if (!ptr.is_empty() && ptr.addr() != 0) {
+                if (!ptr.is_empty() && ptr.addr() != 0 && !g_stable_placement.keeps(rom, ptr.addr())) {
                     clean_patch.fprintf("autoclean $%06X\n", ptr.addr());
                 }
             }
@@ -991,13 +1427,8 @@ bool fill_single_sprite(sprite* spr, std::span<std::string> prints) {
 
         // Version 1.01 stuff:
         if (version >= 1) {
-            clean_sprite_generic(clean_patch, 0x00A68A, 0x9C1498, SPRITE_COUNT, "\n\n;Cluster:\n", rom);
-            clean_sprite_generic(clean_patch, 0x029B1F, 0x176FBC, SPRITE_COUNT, "\n\n;Extended:\n", rom);
-            clean_sprite_generic(clean_patch, 0x028B70, 0x942016, LESS_SPRITE_COUNT, "\n\n;MinorExtended:\n", rom);
-            clean_sprite_generic(clean_patch, 0x029058, 0x03F016, LESS_SPRITE_COUNT, "\n\n;Bounce:\n", rom);
-            clean_sprite_generic(clean_patch, 0x0296C4, 0x7F2912, LESS_SPRITE_COUNT, "\n\n;Smoke:\n", rom);
-            clean_sprite_generic(clean_patch, 0x0299D8, 0x2003F0, MINOR_SPRITE_COUNT, "\n\n;SpinningCoin:\n", rom);
-            clean_sprite_generic(clean_patch, 0x02ADBE, 0xF016E1, MINOR_SPRITE_COUNT, "\n\n;Score:\n", rom);
+            for (const misc_table_location& location : MISC_TABLES)
+                clean_sprite_generic(clean_patch, location, terminated, rom);
         }
 
         // everything else is being cleaned by the main patch itself.
@@ -1072,9 +1503,64 @@ std::vector<definedata> create_config_defines() {
         defines.push_back({.name = "PerLevel", .contents = (cfg.PerLevel ? "1" : "0")});
         defines.push_back({.name = "Disable255SpritesPerLevel", .contents = (cfg.Disable255Sprites ? "1" : "0")});
     }
+    // the routine macros only print the calls the manifest lists when there is one
+    defines.push_back({.name = "PIXI_MANIFEST", .contents = (cfg.ManifestFile.empty() ? "0" : "1")});
     return defines;
 }
 
+bool has_custom_status_ptrs(const sprite& spr) {
+    for (const pointer& ptr : {spr.ptrs.carriable, spr.ptrs.kicked, spr.ptrs.carried, spr.ptrs.mouth, spr.ptrs.goal}) {
+        if (!ptr.is_empty() && ptr.addr() != 0x000000)
+            return true;
+    }
+    return false;
+}
+
+// returns the number of global sprites that need an entry in the custom status pointer table (highest user + 1)
+int custom_status_ptr_count(const sprite* sprite_list) {
+    const sprite* globals = sprite_list + (cfg.PerLevel ? PER_LEVEL_SPRITE_COUNT : 0);
+    for (int i = 0x100; i > 0; i--) {
+        if (has_custom_status_ptrs(globals[i - 1]))
+            return i;
+    }
+    return 0;
+}
+
+// these defines are only known after every sprite has been patched, they let main.asm leave out the dispatch paths that
+// the current sprite set can never take.
+void add_dispatch_defines(const sprite* sprite_list, int status_ptr_count) {
+    static std::string status_ptr_count_str{};
+    static std::string per_level_first_str{};
+    static std::string per_level_last_str{};
+    const bool per_level_lookup = cfg.PerLevel && PLS_DATA_ADDR != 0;
+    bool custom_status_ptrs = status_ptr_count != 0;
+    if (per_level_lookup && !custom_status_ptrs) {
+        custom_status_ptrs = std::any_of(sprite_list, sprite_list + PER_LEVEL_SPRITE_COUNT, has_custom_status_ptrs);
+    }
+    status_ptr_count_str = std::to_string(status_ptr_count);
+    per_level_first_str = fstring("$%02X", cfg.PerLevelSlots.first);
+    per_level_last_str = fstring("$%02X", cfg.PerLevelSlots.last);
+    g_config_defines.push_back({.name = "PerLevelLookup", .contents = (per_level_lookup ? "1" : "0")});
+    g_config_defines.push_back({.name = "PerLevelFirst", .contents = per_level_first_str.c_str()});
+    g_config_defines.push_back({.name = "PerLevelLast", .contents = per_level_last_str.c_str()});
+    g_config_defines.push_back({.name = "CustomStatusPtrs", .contents = (custom_status_ptrs ? "1" : "0")});
+    g_config_defines.push_back({.name = "CustomStatusPtrCount", .contents = status_ptr_count_str.c_str()});
+    io.debug("Dispatch: per-level lookup %s, custom status pointers %s (%d global entries)\n",
+             per_level_lookup ? "on" : "off", custom_status_ptrs ? "on" : "off", status_ptr_count);
+}
+
+// !<type>Count is the size of each misc sprite table, the hijacks skip the sprite numbers that don't fit in it
+void add_misc_count_defines(const std::array<size_t, FromEnum(ListType::__SIZE__)>& counts) {
+    static std::array<std::string, FromEnum(ListType::__SIZE__)> names{};
+    static std::array<std::string, FromEnum(ListType::__SIZE__)> values{};
+    for (const auto& [type, size] : sprite_sizes) {
+        const size_t i = FromEnum(type);
+        names[i] = std::string{misc_type_names[i]} + "Count";
+        values[i] = fstring("$%02X", static_cast<unsigned int>(counts[i]));
+        g_config_defines.push_back({.name = names[i].c_str(), .contents = values[i].c_str()});
+    }
+}
+
 std::vector<std::string> listExtraAsm(const std::string& path, bool& has_error) {
     has_error = false;
     std::vector<std::string> extraDefines;
@@ -1097,7 +1583,308 @@ std::vector<std::string> listExtraAsm(const std::string& path, bool& has_error)
     return extraDefines;
 }
 
-[[nodiscard]] bool create_shared_patch(const std::string& routine_path, const PixiConfig& config) {
+constexpr std::string_view CORE_FILE_SEPARATOR = "__PIXI_INTERNAL_CORE_FILE__";
+
+[[nodiscard]] patchfile create_core_patch(const std::vector<std::string>& files) {
+    patchfile core_patch{"pixi_core.asm"};
+    core_patch.fprintf("warnings push\n"
+                       "warnings disable Wrelative_path_used\n"
+                       "warnings disable W65816_xx_y_assume_16_bit\n");
+    for (size_t i = 0; i < files.size(); i++) {
+        std::string escaped_file = escapeDefines(files[i]);
+        core_patch.fprintf("print \"%s %zu\"\n"
+                           "namespace %s%zu\n"
+                           "incsrc \"%s\"\n"
+                           "namespace off\n",
+                           CORE_FILE_SEPARATOR.data(), i, CORE_NAMESPACE.data(), i, escaped_file.c_str());
+    }
+    core_patch.fprintf("warnings pull\n");
+    core_patch.close();
+    return core_patch;
+}
+
+// applies pixi's own core patches in a single asar invocation, each file gets its own namespace so that their labels
+// don't collide and is preceded by a print so that asar's prints can be attributed to it.
+// if the combined patch fails the files are applied one by one as before, asar doesn't touch the rom buffer on failure
+// and this also reports the errors against the right file.
+// ExtraHijacks aren't part of it, defines, mapper, optimize/bankcross settings and pushpc state would carry over from
+// one file into the next, see patch_extra_hijacks
+[[nodiscard]] bool patch_core_files(const std::vector<std::string>& files, ROM& rom) {
+    // clang-format off
+    constexpr warnsetting disabled_warnings[] {
+        {.warnid = "Wrelative_path_used", .enabled = false},
+        {.warnid = "W65816_xx_y_assume_16_bit", .enabled = false}
+    };
+    patchfile core_patch = create_core_patch(files);
+    addtempfile tmp{core_patch};
+    patchparams params {
+        .structsize = sizeof(patchparams),
+        .patchloc = core_patch.path().c_str(),
+        .romdata = rom.asar_buffer(),
+        .buflen = MAX_ROM_SIZE,
+        .romlen = &rom.size,
+        .includepaths = nullptr,
+        .numincludepaths = 0,
+        .should_reset = true,
+        .additional_defines = g_config_defines.data(),
+        .additional_define_count = static_cast<int>(g_config_defines.size()),
+        .stdincludesfile = cfg.AsarStdIncludes.empty() ? nullptr : cfg.AsarStdIncludes.c_str(),
+        .stddefinesfile = cfg.AsarStdDefines.empty() ? nullptr : cfg.AsarStdDefines.c_str(),
+        .warning_settings = disabled_warnings,
+        .warning_setting_count = static_cast<int>(array_size(disabled_warnings)),
+        .memory_files = g_memory_files.data(),
+        .memory_file_count = static_cast<int>(g_memory_files.size()),
+        .override_checksum_gen = true,
+        .generate_checksum = false
+    };
+    // clang-format on
+    if (!asar_patch_ex(&params)) {
+        int error_count = 0;
+        const errordata* errors = asar_geterrors(&error_count);
+        for (int i = 0; i < error_count; i++)
+            io.debug("Combined core patch error: %s\n", errors[i].fullerrdata);
+        io.debug("Applying the core patches one by one\n");
+        for (const std::string& file : files) {
+            if (!patch(file.c_str(), rom))
+                return false;
+        }
+        return true;
+    }
+    int warn_count = 0;
+    const errordata* loc_warnings = asar_getwarnings(&warn_count);
+    for (int i = 0; i < warn_count; i++)
+        warnings.emplace_back(loc_warnings[i].fullerrdata);
+
+    int print_count = 0;
+    const char* const* asar_prints = asar_getprints(&print_count);
+    const char* current_file = core_patch.path().c_str();
+    for (int i = 0; i < print_count; i++) {
+        std::string_view print{asar_prints[i]};
+        if (print.starts_with(CORE_FILE_SEPARATOR)) {
+            size_t index = std::strtoul(asar_prints[i] + CORE_FILE_SEPARATOR.size(), nullptr, 10);
+            if (index < files.size())
+                current_file = files[index].c_str();
+            continue;
+        }
+        io.debug("From file \"%s\": %s\n", current_file, asar_prints[i]);
+    }
+
+    collect_symbols();
+    return true;
+}
+
+// every ExtraHijacks patch is applied on its own, after the core patches
+[[nodiscard]] bool patch_extra_hijacks(const std::vector<std::string>& extraHijacks, ROM& rom) {
+    if (!extraHijacks.empty()) {
+        io.debug("-------- ExtraHijacks prints --------\n");
+    }
+    for (const std::string& patchUri : extraHijacks) {
+        if (!patch(patchUri.c_str(), rom))
+            return false;
+        int count_extra_prints = 0;
+        auto prints = asar_getprints(&count_extra_prints);
+        for (int i = 0; i < count_extra_prints; i++) {
+            io.debug("From file \"%s\": %s\n", patchUri.c_str(), prints[i]);
+        }
+    }
+    return true;
+}
+
+// hash of every input of the core patches, written by main.asm right after the pixi header.
+// $02FFEA used to hold the per-level table banks of pixi 1.2x, which is never read for newer versions.
+constexpr int CORE_HASH_ADDRESS = 0x02FFEA;
+
+// generated tables that can be rewritten in place when the core patches didn't change,
+// found through the pointers that the core patches leave in the rom.
+// per-level tables are only referenced from code so they always need a full pass.
+struct core_table {
+    std::string_view file;
+    int pointer_address;
+};
+constexpr core_table CORE_TABLES[]{
+    {"_defaulttables.bin", 0x02FFEE},   {"_customstatusptr.bin", 0x02FFFD},   {"_customsize.bin", 0x0EF30C},
+    {"_clusterptr.bin", 0x00A68A},      {"_extendedptr.bin", 0x029B1F},       {"_extendedcapeptr.bin", 0x029637},
+    {"_minorextendedptr.bin", 0x028B70}, {"_bounceptr.bin", 0x029058},         {"_smokeptr.bin", 0x0296C4},
+    {"_spinningcoinptr.bin", 0x0299D8}, {"_scoreptr.bin", 0x02ADBE},
+};
+// _customsize.bin is included right after this file
+constexpr std::string_view DEFAULT_SIZE_FILE = "DefaultSize.bin";
+
+void hash_file(fnv1a_hash& hash, const std::string& path) {
+    // a missing file hashes as an empty one, the patch that includes it will report the error
+    file_buffer contents{};
+    (void)contents.open(path, false);
+    hash.update(path);
+    hash.update(contents.view());
+}
+
+const memoryfile* find_binfile(const std::vector<patchfile>& binfiles, std::string_view name) {
+    for (const patchfile& binfile : binfiles) {
+        if (std::string_view{binfile.path()}.ends_with(name))
+            return &binfile.vfile();
+    }
+    return nullptr;
+}
+
+// the path of an incsrc/incbin on this line, empty if there's none
+std::string_view included_path(std::string_view line, bool& binary) {
+    using namespace std::string_view_literals;
+    line = line.substr(0, line.find(';'));
+    for (std::string_view command : {"incsrc"sv, "incbin"sv}) {
+        const auto it = std::search(line.begin(), line.end(), command.begin(), command.end(),
+                                    [](char a, char b) { return std::tolower(static_cast<unsigned char>(a)) == b; });
+        if (it == line.end())
+            continue;
+        std::string_view rest = line.substr(static_cast<size_t>(it - line.begin()) + command.size());
+        if (rest.empty() || (rest.front() != ' ' && rest.front() != '\t'))
+            continue;
+        rest.remove_prefix(std::min(rest.find_first_not_of(" \t"), rest.size()));
+        binary = command == "incbin"sv;
+        if (rest.starts_with('"'))
+            return rest.substr(1, rest.find('"', 1) - 1);
+        return rest.substr(0, rest.find_first_of(" \t\r"));
+    }
+    return {};
+}
+
+// hashes a patch and everything it includes, the tables pixi generates are left to hash_core_inputs. Returns false if
+// an include can't be followed (a define or macro argument in the path, or a file that's only found through the
+// stdincludes paths), the patch could then change without the hash changing.
+[[nodiscard]] bool hash_patch_tree(fnv1a_hash& hash, const std::string& path, std::vector<std::string>& visited) {
+    if (std::find(visited.begin(), visited.end(), path) != visited.end())
+        return true;
+    visited.push_back(path);
+    file_buffer contents{};
+    (void)contents.open(path, false);
+    hash.update(path);
+    hash.update(contents.view());
+
+    const std::string dir = path.substr(0, path.find_last_of("/\\") + 1);
+    line_reader lines{contents.view()};
+    std::string_view line{};
+    while (lines.next(line)) {
+        bool binary = false;
+        const std::string_view included = included_path(line, binary);
+        if (included.empty())
+            continue;
+        if (included.find_first_of("!<") != std::string_view::npos)
+            return false;
+        const std::string resolved = fs::path{std::string{included}}.is_absolute() ? std::string{included}
+                                                                                    : dir + std::string{included};
+        auto lower = [](std::string text) {
+            std::transform(text.begin(), text.end(), text.begin(),
+                           [](char c) { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); });
+            return text;
+        };
+        const std::string lower_included = lower(std::string{included});
+        const std::string lower_resolved = lower(resolved);
+        const auto memory_file = std::find_if(g_memory_files.begin(), g_memory_files.end(), [&](const memoryfile& file) {
+            return lower_included == file.path || lower_resolved == file.path;
+        });
+        if (memory_file != g_memory_files.end()) {
+            // the generated tables only count with their size, which hash_core_inputs takes care of
+            if (!std::string_view{memory_file->path}.ends_with(".bin")) {
+                hash.update(memory_file->path);
+                hash.update(memory_file->buffer, memory_file->length);
+            }
+        } else if (!fs::exists(resolved)) {
+            return false;
+        } else if (binary) {
+            hash_file(hash, resolved);
+        } else if (!hash_patch_tree(hash, resolved, visited)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// the tables themselves are left out (they're rewritten in place), only their sizes matter since they decide where
+// everything that follows them ends up. nullopt when the inputs can't all be hashed, the core patches are always
+// applied then.
+std::optional<uint32_t> hash_core_inputs(const std::vector<std::string>& files, const std::vector<patchfile>& binfiles,
+                                         const std::deque<plugins::plugin_context::owned_file>& plugin_files,
+                                         const ROM& rom) {
+    fnv1a_hash hash{};
+    hash.update_value(VERSION_FULL);
+    hash.update_value(rom.mapper);
+    std::vector<std::string> visited{};
+    for (const std::string& file : files) {
+        if (!hash_patch_tree(hash, file, visited)) {
+            io.debug("Core patch inputs of %s can't all be hashed, the core patches will be applied\n", file.c_str());
+            return std::nullopt;
+        }
+    }
+    if (!cfg.AsarStdIncludes.empty())
+        hash_file(hash, cfg.AsarStdIncludes);
+    if (!cfg.AsarStdDefines.empty())
+        hash_file(hash, cfg.AsarStdDefines);
+    for (const definedata& define : g_config_defines) {
+        hash.update(define.name);
+        hash.update(define.contents);
+    }
+    for (const patchfile& binfile : binfiles) {
+        hash.update(binfile.path());
+        hash.update_value(binfile.vfile().length);
+    }
+    // files generated by plugins may be included by the core patches or ExtraHijacks
+    for (const auto& plugin_file : plugin_files) {
+        hash.update(plugin_file.path);
+        hash.update(plugin_file.data.data(), plugin_file.data.size());
+    }
+    return static_cast<uint32_t>(hash.value() ^ (hash.value() >> 32));
+}
+
+bool can_skip_core_patches(uint32_t core_hash, const ROM& rom) {
+    // per-level tables can't be found from the rom and the labels for the symbols only come from asar
+    if (cfg.PerLevel || symbols_requested())
+        return false;
+    if (strncmp(reinterpret_cast<const char*>(rom.data) + rom.snes_to_pc(0x02FFE2), "STSD", 4) != 0)
+        return false;
+    const int hash_address = rom.snes_to_pc(CORE_HASH_ADDRESS, false);
+    uint32_t stored_hash = 0;
+    for (int i = 0; i < 4; i++)
+        stored_hash |= static_cast<uint32_t>(rom.real_data[hash_address + i]) << (i * 8);
+    return stored_hash == core_hash;
+}
+
+// writes the tables over the ones inserted by the previous run, nothing is written unless every table can be found
+[[nodiscard]] bool update_core_tables(const std::vector<patchfile>& binfiles, ROM& rom) {
+    struct table_write {
+        int pc_address;
+        const memoryfile* file;
+    };
+    std::vector<table_write> writes{};
+    std::error_code ec{};
+    const auto default_size = fs::file_size(cfg[PathType::Asm] + DEFAULT_SIZE_FILE.data(), ec);
+    if (ec)
+        return false;
+    for (const core_table& table : CORE_TABLES) {
+        const memoryfile* file = find_binfile(binfiles, table.file);
+        if (file == nullptr)
+            continue;
+        int address = rom.pointer_snes(table.pointer_address).addr();
+        if (table.file == "_customsize.bin")
+            address += static_cast<int>(default_size);
+        const int pc_address = rom.snes_to_pc(address, false);
+        if (pc_address < 0 || pc_address + static_cast<int>(file->length) > rom.size) {
+            io.debug("Couldn't locate %s in the rom ($%06X), applying the core patches\n", table.file.data(),
+                     address);
+            return false;
+        }
+        writes.push_back({pc_address, file});
+    }
+    const memoryfile* versionflag = find_binfile(binfiles, "_versionflag.bin");
+    if (versionflag == nullptr)
+        return false;
+    writes.push_back({rom.snes_to_pc(0x02FFE6, false), versionflag});
+
+    for (const table_write& write : writes)
+        memcpy(rom.real_data + write.pc_address, write.file->buffer, write.file->length);
+    return true;
+}
+
+// runs as a task, routine_count is printed by the caller once it's done so the output keeps its order
+[[nodiscard]] bool create_shared_patch(const std::string& routine_path, const PixiConfig& config, int& routine_count) {
     namespace fs = std::filesystem;
 
     std::string escapedRoutinepath = escapeDefines(routine_path, R"(\\\!)");
@@ -1114,6 +1901,7 @@ std::vector<std::string> listExtraAsm(const std::string& path, bool& has_error)
                                   "	    			namespace <base>\n"
                                   "	    			incsrc \"<target>\"\n"
                                   "                   namespace off\n"
+                                  "	    			print \"__PIXI_INTERNAL_ROUTINE_SIZE__ <base> \", hex(<base>), \" \", hex(pc())\n"
                                   "	    		ORG <offset>+$03E05C\n"
                                   "	    			dl <base>\n"
                                   "	    	endif\n"
@@ -1124,7 +1912,7 @@ std::vector<std::string> listExtraAsm(const std::string& path, bool& has_error)
                                   "    endif\n"
                                   "endmacro\n"
                                   "macro safe_macro_label_wrapper()\n");
-    int routine_count = 0;
+    routine_count = 0;
     if (!fs::exists(cleanPathTrail(routine_path))) {
         io.error("Couldn't open folder \"%s\" for reading.", routine_path.c_str());
         return false;
@@ -1151,13 +1939,51 @@ std::vector<std::string> listExtraAsm(const std::string& path, bool& has_error)
             }
             const char* charName = name.c_str();
             const char* charPath = path.c_str();
-            g_shared_patch.fprintf("macro %s()\n"
-                                   "\t!%s ?= 1\n"
-                                   "\tJSL %s\n"
-                                   "endmacro\n",
-                                   charName, charName, charName, charName);
+            file_buffer routine_source{};
+            if (!routine_source.open(p.string()))
+                return false;
+            inline_routine inlined{};
+            std::string inline_error{};
+            if (!make_inline_routine(routine_source.view(), inlined, inline_error)) {
+                io.error("Routine %s is marked for inlining but can't be inlined: %s\n", charName, inline_error.c_str());
+                return false;
+            }
+            if (inlined.requested) {
+                // sprites can opt out (or back in) by setting !pixi_inline_<name> before the call
+                g_shared_patch.fprintf("!pixi_inline_%s ?= %d\n"
+                                       "macro %s()\n"
+                                       "\tif !pixi_inline_%s\n"
+                                       "\t\t?pixi_inline_start:\n"
+                                       "%s"
+                                       "\t\tprint \"%s %s \", dec(pc()-?pixi_inline_start)\n"
+                                       "\telse\n"
+                                       "\t\t!%s ?= 1\n"
+                                       "\t\tif !PIXI_MANIFEST\n"
+                                       "\t\t\tprint \"%s %s\"\n"
+                                       "\t\tendif\n"
+                                       "\t\tJSL %s%s\n"
+                                       "\tendif\n"
+                                       "endmacro\n",
+                                       charName, inlined.default_inline ? 1 : 0, charName, charName,
+                                       inlined.body.c_str(), INLINE_PRINT_TAG.data(), charName, charName,
+                                       ROUTINE_CALL_PRINT_TAG.data(), charName, charName,
+                                       config.FastRom ? "|$800000" : "");
+                io.debug("Routine %s can be inlined (%s by default)\n", charName,
+                         inlined.default_inline ? "inlined" : "called");
+            } else {
+                g_shared_patch.fprintf("macro %s()\n"
+                                       "\t!%s ?= 1\n"
+                                       "\tif !PIXI_MANIFEST\n"
+                                       "\t\tprint \"%s %s\"\n"
+                                       "\tendif\n"
+                                       "\tJSL %s%s\n"
+                                       "endmacro\n",
+                                       charName, charName, ROUTINE_CALL_PRINT_TAG.data(), charName, charName,
+                                       config.FastRom ? "|$800000" : "");
+            }
             g_shared_inscrc_patch.fprintf("\t%%include_once(\"%s%s\", %s, $%02X)\n", escapedRoutinepath.c_str(),
                                           charPath, charName, routine_count * 3);
+            g_routine_names.push_back(name);
             routine_count++;
         }
         g_shared_inscrc_patch.fprintf("endmacro\n\n"
@@ -1171,11 +1997,8 @@ std::vector<std::string> listExtraAsm(const std::string& path, bool& has_error)
                  err.what());
         return false;
     }
-    io.print("%d Shared routines registered in \"%s\"\n", routine_count, routine_path.data());
     g_shared_patch.close();
     g_shared_inscrc_patch.close();
-    g_memory_files.push_back(g_shared_patch.vfile());
-    g_memory_files.push_back(g_shared_inscrc_patch.vfile());
     return true;
 }
 
@@ -1183,75 +2006,48 @@ std::vector<std::string> listExtraAsm(const std::string& path, bool& has_error)
                                         const std::array<sprite*, FromEnum(ListType::__SIZE__)>& sprite_lists,
                                         std::string_view listPath, const ROM* rom) {
     using namespace std::string_view_literals;
-    std::ifstream listStream{listPath.data()};
-    if (!listStream) {
+    file_buffer listContents{};
+    if (!listContents.open(std::string{listPath}, false)) {
         io.error("Could not open list file \"%s\" for reading: %s", listPath.data(), strerror(errno));
         return false;
     }
-    unsigned int sprite_id, level;
-    int lineno = 0;
-    int read_res;
-    std::string line;
+    list_lexer lexer{listContents.view()};
+    list_line line{};
     ListType type = ListType::Sprite;
     sprite* spr = nullptr;
-    char cfgname[FILENAME_MAX] = {0};
     const char* dir = nullptr;
-    while (std::getline(listStream, line)) {
-        int read_until = -1;
+    normal_sprite_slots normal_slots{sprite_lists[FromEnum(ListType::Sprite)]};
+    while (lexer.next(line)) {
         sprite* sprite_list = sprite_lists[FromEnum(type)];
-        // possible line formats: xxx:yy filename.<cfg/json/asm> [; ...]
-        //						  yy filename.<cfg/json/asm> [; ...]
-        // 						  TYPE: [; ...]
-        lineno++;
-        if (line.find(';') != std::string::npos)
-            line.erase(line.begin() + line.find_first_of(';'), line.end());
-        trim(line);
-        if (line.empty())
+        const int lineno = line.lineno;
+        switch (line.type) {
+        case list_line::kind::malformed:
+            io.error("List line %d was malformed at column %zu, %s: \"%s\"\n", lineno, line.column, line.error,
+                     std::string{line.text}.c_str());
+            return false;
+        case list_line::kind::unknown_header:
+            io.print("Warning on list line %d: unknown sprite type %s, the sprites after it are inserted as the "
+                     "previous type\n",
+                     lineno, std::string{line.text}.c_str());
             continue;
-        if (line.find(':') == std::string::npos) { // if there's no : in the string, it's a non per-level sprite
-            level = 0x200;
-            read_res = sscanf(line.c_str(), "%x %n", &sprite_id, &read_until);
-            if (read_res != 1 || read_res == EOF || read_until == -1) {
-                io.error("List line %d was malformed: \"%s\"\n", lineno, line.c_str());
-                return false;
-            }
-            strcpy(cfgname, line.c_str() + read_until);
-        } else if (line.find(':') == line.length() - 1) { // if it's the last char in the string, it's a type change
-            using svt = std::pair<std::string_view, ListType>;
-            constexpr std::array typeArray{svt{"SPRITE:"sv, ListType::Sprite},
-                                           svt{"CLUSTER:"sv, ListType::Cluster},
-                                           svt{"EXTENDED:"sv, ListType::Extended},
-                                           svt{"MINOREXTENDED:"sv, ListType::MinorExtended},
-                                           svt{"BOUNCE:"sv, ListType::Bounce},
-                                           svt{"SMOKE:"sv, ListType::Smoke},
-                                           svt{"SPINNINGCOIN:"sv, ListType::SpinningCoin},
-                                           svt{"SCORE:"sv, ListType::Score}};
-            auto it = std::find_if(typeArray.begin(), typeArray.end(),
-                                   [&line](const svt& svtl) { return svtl.first == line; });
-            if (it != typeArray.end()) {
-                type = it->second;
-            }
+        case list_line::kind::header:
+            type = line.list_type;
             continue;
-        } else { // if there's a ':' but it's not at the end, it may be a per level sprite
-            read_res = sscanf(line.c_str(), "%x:%x %n", &level, &sprite_id, &read_until);
-            if (read_res != 2 || read_res == EOF || read_until == -1) {
-                io.error("List line %d was malformed: \"%s\"\n", lineno, line.c_str());
-                return false;
-            }
-            if (!cfg.PerLevel) {
-                io.error("Trying to insert per level sprites without using the -pl flag, at list line %d: \"%s\"\n",
-                         lineno, line.c_str());
-                return false;
-            }
-            strcpy(cfgname, line.c_str() + read_until);
+        case list_line::kind::sprite:
+            break;
         }
-
-        char* dot = strrchr(cfgname, '.');
-        if (dot == nullptr) {
-            io.error("Error on list line %d: missing extension on filename %s\n", lineno, cfgname);
+        const unsigned int sprite_id = line.number;
+        const unsigned int level = line.level;
+        if (line.per_level && !cfg.PerLevel) {
+            io.error("Trying to insert per level sprites without using the -pl flag, at list line %d: \"%s\"\n",
+                     lineno, std::string{line.text}.c_str());
+            return false;
+        }
+        if (line.extension.empty()) {
+            io.error("Error on list line %d: missing extension on filename %s\n", lineno,
+                     std::string{line.filename}.c_str());
             return false;
         }
-        dot++;
 
         if (rom != nullptr) {
             if (sprite_id == GOAL_POST_SPRITE_ID && rom->is_exlevel()) {
@@ -1268,31 +2064,31 @@ std::vector<std::string> listExtraAsm(const std::string& path, bool& has_error)
         }
 
         if (type == ListType::Sprite) {
-            spr = from_table<sprite>(sprite_list, level, sprite_id);
-            // verify sprite pointer and determine cause if invalid
+            if (sprite_id >= 0x100) {
+                io.error("Error on list line %d: Sprite number must be less than 0x100\n", lineno);
+                return false;
+            }
+            if (level > 0x200) {
+                io.error("Error on list line %d: Level must range from 000-1FF\n", lineno);
+                return false;
+            }
+            const per_level_range& slots = cfg.PerLevelSlots;
+            if (cfg.PerLevel && level != 0x200 && !slots.contains(static_cast<int>(sprite_id))) {
+                io.error("Error on list line %d: Per-level sprite valid range is %02X-%02X, was given %X instead\n",
+                         lineno, slots.first, slots.last, sprite_id);
+                return false;
+            }
+            spr = normal_slots.get(static_cast<int>(level), static_cast<int>(sprite_id));
             if (!spr) {
-                if (sprite_id >= 0x100) {
-                    io.error("Error on list line %d: Sprite number must be less than 0x100\n", lineno);
-                    return false;
-                }
-                if (level > 0x200) {
-                    io.error("Error on list line %d: Level must range from 000-1FF\n", lineno);
-                    return false;
-                }
-                if (cfg.PerLevel && level != 0x200 && (sprite_id < 0xB0 || sprite_id >= 0xC0)) {
-                    io.error("Error on list line %d: Per-level sprite valid range is B0-BF, was given %X instead\n",
-                             lineno, sprite_id);
-                    return false;
-                }
-                io.error("Error on list line %d: Sprite was invalid, couldn't determine the specific reason, please "
-                         "report this at " GITHUB_ISSUE_LINK,
-                         lineno);
+                io.error("Error on list line %d: Too many per-level sprites, the maximum is %zu\n", lineno,
+                         PER_LEVEL_SPRITE_COUNT);
                 return false;
             }
         } else {
-            size_t max_size = sprite_sizes[static_cast<size_t>(FromEnum(type)) - 1].second;
-            if (sprite_id > max_size) {
-                io.error("Error on list line %d: Sprite number must be less than %x\n", lineno, max_size);
+            const size_t capacity = cfg.MiscCapacities[FromEnum(type)];
+            const size_t max_size = capacity != 0 ? capacity : SPRITE_COUNT;
+            if (sprite_id >= max_size) {
+                io.error("Error on list line %d: Sprite number must be less than %zX\n", lineno, max_size);
                 return false;
             }
             spr = sprite_list + sprite_id;
@@ -1324,29 +2120,29 @@ std::vector<std::string> listExtraAsm(const std::string& path, bool& has_error)
                 dir = paths[PathType::Generators].c_str();
         }
         spr->directory = dir;
-        std::string fullFileName = std::string{dir} + std::string{cfgname};
+        std::string fullFileName = std::string{dir} + std::string{line.filename};
 
         if (type != ListType::Sprite) {
-            if (strcmp(dot, "asm") && strcmp(dot, "ASM")) {
-                io.error("Error on list line %d: not an asm file\n", lineno, fullFileName.c_str());
+            if (line.extension != "asm"sv && line.extension != "ASM"sv) {
+                io.error("Error on list line %d: %s is not an asm file\n", lineno, fullFileName.c_str());
                 return false;
             }
             spr->asm_file = std::move(fullFileName);
         } else {
             spr->cfg_file = std::move(fullFileName);
-            if (!strcmp(dot, "cfg") || !strcmp(dot, "CFG")) {
+            if (line.extension == "cfg"sv || line.extension == "CFG"sv) {
                 if (!read_cfg_file(spr)) {
                     io.error("Error on list line %d: Cannot parse CFG file %s.\n", lineno, spr->cfg_file.c_str());
                     return false;
                 }
 
-            } else if (!strcmp(dot, "json") || !strcmp(dot, "JSON")) {
+            } else if (line.extension == "json"sv || line.extension == "JSON"sv) {
                 if (!read_json_file(spr)) {
                     io.error("Error on list line %d: Cannot parse JSON file %s.\n", lineno, spr->cfg_file.c_str());
                     return false;
                 }
             } else {
-                io.error("Error on list line %d: Unknown filetype %s\n", lineno, dot);
+                io.error("Error on list line %d: Unknown filetype %s\n", lineno, std::string{line.extension}.c_str());
                 return false;
             }
         }
@@ -1387,12 +2183,45 @@ std::vector<std::string> listExtraAsm(const std::string& path, bool& has_error)
     }
 }
 
-FILE* open_subfile(ROM& rom, const char* ext, const char* mode) {
+// copies the -ssc/-mwt/-mw2 files at the start of the rom's own, the base files are copied line by line so that they
+// always end with a newline
+[[nodiscard]] bool read_lm_base_files(file_writer& ssc, file_writer& mwt, file_writer& mw2) {
+    for (auto [ext, writer] : {std::pair{ExtType::Ssc, &ssc}, std::pair{ExtType::Mwt, &mwt}}) {
+        if (cfg[ext].empty())
+            continue;
+        file_buffer fin{};
+        if (!fin.open(cfg[ext]))
+            return false;
+        line_reader lines{fin.view()};
+        std::string line;
+        while (lines.next(line)) {
+            writer->write(line);
+            writer->put('\n');
+        }
+    }
+
+    if (!cfg[ExtType::Mw2].empty()) {
+        file_buffer fin{};
+        if (!fin.open(cfg[ExtType::Mw2])) {
+            io.error("Couldn't fully read file %s, please check file permissions", cfg[ExtType::Mw2].c_str());
+            return false;
+        }
+        if (fin.size() == 0) {
+            // if size == 0, it means that the file is empty, so we just append the 0x00 and go on with our lives
+            mw2.put(0x00);
+        } else {
+            mw2.write(fin.data(), fin.size() - 1); // -1 to skip the 0xFF byte at the end
+        }
+    } else {
+        mw2.put(0x00); // binary data starts with 0x00
+    }
+    return true;
+}
+
+file_writer& open_subfile(output_transaction& outputs, ROM& rom, const char* ext, bool text) {
     fs::path path{rom.name};
     path.replace_extension(ext);
-    std::string spath = path.generic_string();
-    FILE* r = open(spath.c_str(), mode);
-    return r;
+    return outputs.add(path.generic_string(), text);
 }
 
 void remove(std::string_view dir, const char* file) {
@@ -1430,6 +2259,7 @@ void pixi_reset() {
     memset(PLS_LEVEL_PTRS, 0, sizeof(PLS_LEVEL_PTRS));
     memset(PLS_SPRITE_PTRS, 0, sizeof(PLS_SPRITE_PTRS));
     PLS_SPRITE_PTRS_ADDR = 0;
+    PLS_LEVEL_SLOTS.clear();
     memset(PLS_DATA, 0, sizeof(PLS_DATA));
     memset(PLS_POINTERS, 0, sizeof(PLS_POINTERS));
     PLS_DATA_ADDR = 0;
@@ -1439,6 +2269,10 @@ void pixi_reset() {
     g_shared_patch.clear();
     g_shared_inscrc_patch.clear();
     g_config_defines.clear();
+    g_routine_names.clear();
+    g_inserted_routines.clear();
+    g_symbols.clear();
+    reset_io_stats();
     patchfile::set_keep(false, false);
     cfg.reset();
 }
@@ -1461,11 +2295,11 @@ PIXI_EXPORT int pixi_run(int argc, const char** argv, bool skip_first) {
     static sprite sprite_list[MAX_SPRITE_COUNT];
     static sprite cluster_list[SPRITE_COUNT];
     static sprite extended_list[SPRITE_COUNT];
-    static sprite minor_extended_list[LESS_SPRITE_COUNT];
-    static sprite bounce_list[LESS_SPRITE_COUNT];
-    static sprite smoke_list[LESS_SPRITE_COUNT];
-    static sprite spinningcoin_list[MINOR_SPRITE_COUNT];
-    static sprite score_list[MINOR_SPRITE_COUNT];
+    static sprite minor_extended_list[SPRITE_COUNT];
+    static sprite bounce_list[SPRITE_COUNT];
+    static sprite smoke_list[SPRITE_COUNT];
+    static sprite spinningcoin_list[SPRITE_COUNT];
+    static sprite score_list[SPRITE_COUNT];
 
     std::vector<plugins::plugin> plugin_list{};
     const fs::path plugins_path = fs::current_path() / "plugins";
@@ -1530,9 +2364,10 @@ PIXI_EXPORT int pixi_run(int argc, const char** argv, bool skip_first) {
     static map16 map[MAP16_SIZE];
     argparser optparser{};
     if (std::filesystem::exists("pixi_settings.json")) {
-        std::ifstream settings_file{"pixi_settings.json"};
+        file_buffer settings_file{};
         nlohmann::json j;
-        settings_file >> j;
+        if (settings_file.open("pixi_settings.json"))
+            j = nlohmann::json::parse(settings_file.view());
         if (!optparser.init(j)) {
             io.error("JSON format of Pixi settings is wrong.");
         }
@@ -1553,10 +2388,19 @@ PIXI_EXPORT int pixi_run(int argc, const char** argv, bool skip_first) {
                     "Resolve list.txt and ssc/mw2/mwt/s16 paths relative to the executable rather than the ROM",
                     cfg.SearchForFilesInExePath)
         .add_option("-k", "Keep debug files", cfg.KeepFiles)
-        .add_option("--symbols", "SYMBOLSTYPE", "Enable writing debugging symbols files in format wla or nocash",
-                    cfg.SymbolsType)
+        .add_option("--symbols", "SYMBOLSTYPE",
+                    "Enable writing a debugging symbols file <romname>.sym in format wla or nocash", cfg.SymbolsType)
+        .add_option("--symbols-index", "INDEXFILE",
+                    "Write a binary address to symbol index of every label, sorted by address", cfg.SymbolsIndexFile)
         .add_option("-l", "list path", "Specify a custom list file", cfg[PathType::List])
         .add_option("-pl", "Per level sprites - will insert perlevel sprite code", cfg.PerLevel)
+        .add_option("--perlevel-range", "RANGE",
+                    "Sprite numbers that can be used by per-level sprites, as FIRST-LAST in hex, up to BF",
+                    cfg.PerLevelRange)
+        .add_option("--misc-capacity", "CAPACITIES",
+                    "Table size of misc sprite types as TYPE=COUNT in hex separated by commas (like cluster=20,score=8), "
+                    "by default each table goes up to the highest slot in use",
+                    cfg.MiscCapacity)
         .add_option("-npl", "Disable per level sprites (default), kept for compatibility reasons", argparser::no_value)
         .add_option("-d255spl", "Disable 255 sprites per level support (won't do the 1938 remap)",
                     cfg.Disable255Sprites)
@@ -1590,6 +2434,34 @@ PIXI_EXPORT int pixi_run(int argc, const char** argv, bool skip_first) {
         .add_option("-meimei-k", "Enables keep temp patches files", meimei.KeepTemp())
         .add_option("-meimei-d", "Enables debug for MeiMei patches", meimei.Debug())
         .add_option("--onepatch", "Applies all sprites into a single big patch", cfg.AllSpritesOnePatch)
+        .add_option("--stable-placement",
+                    "Assemble the sprites where they were inserted by the previous run when they still fit there",
+                    cfg.StablePlacement)
+        .add_option("--fastrom",
+                    "Use the FastROM ($80+) bank mirrors for sprite pointers and shared routine calls, requires a "
+                    "FastROM LoROM",
+                    cfg.FastRom)
+        .add_option("--manifest", "MANIFESTFILE",
+                    "Write a JSON description of every inserted sprite and shared routine (pointers, size, bank, "
+                    "routines used)",
+                    cfg.ManifestFile)
+        .add_option("--bps", "PATCHFILE", "Write a BPS patch from the ROM as it was read to the ROM as it's written",
+                    cfg.BpsFile)
+        .add_option("--ips", "PATCHFILE", "Write an IPS patch from the ROM as it was read to the ROM as it's written",
+                    cfg.IpsFile)
+        .add_option("--patch-only",
+                    "Don't write the ROM, only the patches requested with --bps and --ips (the Lunar Magic files are "
+                    "still written)",
+                    cfg.PatchOnly)
+        .add_option("--profile", "FRAMES",
+                    "Run INIT and FRAMES calls of MAIN of each normal sprite on a 65816 interpreter and print their "
+                    "cycle counts",
+                    cfg.ProfileFrames)
+        .add_option("--threads", "THREADS",
+                    "Maximum number of threads used for the work that runs alongside asar (reading the base LM files, "
+                    "scanning folders, generating the LM data) and for MeiMei's level remapping, 0 uses one per CPU "
+                    "core",
+                    cfg.Threads)
         .add_option("--stdincludes", "INCLUDEPATH", "Specify a text file with a list of search paths for asar",
                     cfg.AsarStdIncludes)
         .add_option("--stddefines", "DEFINEPATH", "Specify a text file with a list of defines for asar",
@@ -1628,6 +2500,36 @@ PIXI_EXPORT int pixi_run(int argc, const char** argv, bool skip_first) {
                  cfg.Routines);
         return EXIT_FAILURE;
     }
+    if (cfg.ProfileFrames < 0) {
+        io.error("The number of frames to profile can't be negative (%d)", cfg.ProfileFrames);
+        return EXIT_FAILURE;
+    }
+    if (cfg.Threads < 0) {
+        io.error("The number of threads can't be negative (%d)", cfg.Threads);
+        return EXIT_FAILURE;
+    }
+    {
+        unsigned int first = 0;
+        unsigned int last = 0;
+        int read_until = -1;
+        if (sscanf(cfg.PerLevelRange.c_str(), "%x-%x%n", &first, &last, &read_until) != 2 ||
+            read_until != static_cast<int>(cfg.PerLevelRange.size()) || first > last || last > 0xBF) {
+            io.error("Invalid --perlevel-range \"%s\", it should be FIRST-LAST in hex with FIRST <= LAST <= BF",
+                     cfg.PerLevelRange.c_str());
+            return EXIT_FAILURE;
+        }
+        cfg.PerLevelSlots = {static_cast<int>(first), static_cast<int>(last)};
+    }
+    if (!parse_misc_capacities(cfg.MiscCapacity))
+        return EXIT_FAILURE;
+    if (cfg.StablePlacement && cfg.AllSpritesOnePatch) {
+        io.error("--stable-placement can't be used with --onepatch, which inserts all the sprites in a single block");
+        return EXIT_FAILURE;
+    }
+    if (cfg.PatchOnly && cfg.BpsFile.empty() && cfg.IpsFile.empty()) {
+        io.error("--patch-only needs at least one of --bps and --ips, otherwise nothing would be written");
+        return EXIT_FAILURE;
+    }
     if (cfg.SymbolsType != "" && cfg.SymbolsType != "wla" && cfg.SymbolsType != "nocash") {
         io.error("Invalid --symbols format. Supported formats are wla or nocash");
         return EXIT_FAILURE;
@@ -1637,10 +2539,10 @@ PIXI_EXPORT int pixi_run(int argc, const char** argv, bool skip_first) {
     if constexpr (PIXI_DEV_BUILD) {
         io.print("Pixi development version %d.%d - %s\n", VERSION_MAJOR, VERSION_PARTIAL, VERSION_DEBUG);
     } else if (version_requested) {
-        const char message[]{"Pixi version %d.%d\n"
-                             "Originally developed in 2017 by JackTheSpades\n"
-                             "Maintained by RPGHacker (2018), Tattletale (2018-2020)\n"
-                             "Currently maintained by Atari2.0 (2020-2024)\n"};
+        static constexpr char message[]{"Pixi version %d.%d\n"
+                                        "Originally developed in 2017 by JackTheSpades\n"
+                                        "Maintained by RPGHacker (2018), Tattletale (2018-2020)\n"
+                                        "Currently maintained by Atari2.0 (2020-2024)\n"};
         io.print(message, VERSION_MAJOR, VERSION_PARTIAL);
         return EXIT_SUCCESS;
     }
@@ -1661,7 +2563,8 @@ PIXI_EXPORT int pixi_run(int argc, const char** argv, bool skip_first) {
 #endif
 
     patchfile::set_keep(cfg.KeepFiles, meimei.KeepTemp());
-    versionflag[1] = (cfg.PerLevel ? 1 : 0);
+    versionflag[1] = (cfg.PerLevel ? 0x05 : 0x00) | 0x08;
+    versionflag[3] = static_cast<unsigned char>(cfg.PerLevelSlots.first);
 
     if (plugins::for_each_plugin(plugin_list, &plugins::plugin::before_patching) != EXIT_SUCCESS) {
         return EXIT_FAILURE;
@@ -1710,6 +2613,11 @@ PIXI_EXPORT int pixi_run(int argc, const char** argv, bool skip_first) {
             return EXIT_FAILURE;
     }
 
+    // the patches are a diff against these bytes, keeping them avoids reading the rom file again at the end
+    std::vector<unsigned char> original_rom{};
+    if (!cfg.BpsFile.empty() || !cfg.IpsFile.empty())
+        original_rom.assign(rom.data, rom.data + rom.size + rom.header_size);
+
     //------------------------------------------------------------------------------------------
     // Check if a newer version has been used before.
     //------------------------------------------------------------------------------------------
@@ -1721,7 +2629,6 @@ PIXI_EXPORT int pixi_run(int argc, const char** argv, bool skip_first) {
         io.error("The ROM has been patched with a newer version of PIXI (%d.%d) already.\n", edition, partial);
         io.error("This is version %d.%d\n", VERSION_MAJOR, VERSION_PARTIAL);
         io.error("Please get a newer version.");
-        rom.close();
         return EXIT_FAILURE;
     }
 
@@ -1733,7 +2640,6 @@ PIXI_EXPORT int pixi_run(int argc, const char** argv, bool skip_first) {
             "modified a level\n");
         char c = io.getc();
         if (tolower(c) == 'y') {
-            rom.close();
             io.error("Insertion was stopped, press any button to exit...\n");
             io.getc();
             return EXIT_FAILURE;
@@ -1749,12 +2655,17 @@ PIXI_EXPORT int pixi_run(int argc, const char** argv, bool skip_first) {
         return EXIT_FAILURE;
     }
 
-    // Initialize MeiMei
-    if (!cfg.DisableMeiMei) {
-        if (!meimei.initialize(rom.name.data()))
-            return EXIT_FAILURE;
+    if (cfg.FastRom && !rom.is_fastrom()) {
+        io.print("Warning: --fastrom was passed but the ROM is not a FastROM LoROM (header byte $%02X), pointers "
+                 "will be left in their slow banks\n",
+                 rom.real_data[0x7fd5]);
+        cfg.FastRom = false;
     }
 
+    // Initialize MeiMei
+    if (!cfg.DisableMeiMei)
+        meimei.initialize(rom);
+
     //------------------------------------------------------------------------------------------
     // set path for directories relative to pixi or rom, not working dir.
     //------------------------------------------------------------------------------------------
@@ -1792,20 +2703,89 @@ PIXI_EXPORT int pixi_run(int argc, const char** argv, bool skip_first) {
     // regular stuff
     //------------------------------------------------------------------------------------------
     g_config_defines = create_config_defines();
-    bool failed = true;
-    std::vector<std::string> extraDefines = listExtraAsm(cfg.AsmDirPath + "/ExtraDefines", failed);
-    if (failed)
-        return EXIT_FAILURE;
+
+    // the rom and the files that go with it are only written once everything has succeeded, all at once
+    output_transaction outputs{};
+    std::vector<std::string> extraDefines{};
+    std::vector<std::string> extraHijacks{};
+    file_writer* s16 = nullptr;
+    file_writer* ssc = nullptr;
+    file_writer* mwt = nullptr;
+    file_writer* mw2 = nullptr;
+
+    // everything that doesn't go through asar runs on the task graph while the main thread parses the list and
+    // patches, declared after everything the tasks use so that it's destroyed (and waits for them) first
+    task_graph tasks{static_cast<unsigned>(cfg.Threads)};
+    auto list_extra_asm_task = [&](std::vector<std::string>& files, std::string path) {
+        return [&files, path = std::move(path)] {
+            bool failed = true;
+            files = listExtraAsm(path, failed);
+            return !failed;
+        };
+    };
+    const auto extra_defines_task =
+        tasks.add("ExtraDefines scan", list_extra_asm_task(extraDefines, cfg.AsmDirPath + "/ExtraDefines"));
+    const auto extra_hijacks_task =
+        tasks.add("ExtraHijacks scan", list_extra_asm_task(extraHijacks, cfg.AsmDirPath + "/ExtraHijacks"));
+    int routine_count = 0;
+    const auto shared_routines_task = tasks.add(
+        "shared routines", [&] { return create_shared_patch(cfg[PathType::Routines], cfg, routine_count); });
+    task_graph::task_id lm_base_files_task{};
+    if (!cfg.DisableAllExtensionFiles) {
+        s16 = &open_subfile(outputs, rom, "s16", false);
+        ssc = &open_subfile(outputs, rom, "ssc", true);
+        mwt = &open_subfile(outputs, rom, "mwt", true);
+        mw2 = &open_subfile(outputs, rom, "mw2", false);
+        lm_base_files_task = tasks.add("LM base files", [&] {
+            if (!cfg[ExtType::S16].empty())
+                read_map16(map, cfg[ExtType::S16].c_str());
+            return read_lm_base_files(*ssc, *mwt, *mw2);
+        });
+    }
+
     if (!populate_sprite_list(cfg.GetPaths(), sprites_list_list, cfg[PathType::List], &rom))
         return EXIT_FAILURE;
 
-    if (!clean_hack(rom, cfg[PathType::Asm]))
+    plugins::plugin_context plugin_context{VERSION_FULL};
+    plugin_context.set_rom(&rom);
+    plugin_context.set_asar_inputs(g_memory_files, g_config_defines);
+    // the lists are refreshed before every hook since inserting the sprites fills in their pointers,
+    // same for the rom since patching can move its buffer or change its size
+    auto run_plugin_stage = [&](auto hook, pixi_plugin_stage stage) {
+        plugin_context.set_stage(stage);
+        plugin_context.set_rom(plugin_context.rom());
+        plugin_context.set_sprite_list(ListType::Sprite, std::span{sprite_list, MAX_SPRITE_COUNT});
+        for (const auto& [type, size] : sprite_sizes) {
+            plugin_context.set_sprite_list(type, std::span{sprites_list_list[FromEnum(type)], size});
+        }
+        return plugins::for_each_plugin(plugin_list, hook, plugin_context.get());
+    };
+    if (run_plugin_stage(&plugins::plugin::after_list_parse, pixi_plugin_after_list_parse) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+
+    sprite_lists_view lists{};
+    lists[FromEnum(ListType::Sprite)] = std::span{sprite_list, MAX_SPRITE_COUNT};
+    for (const auto& [type, size] : sprite_sizes) {
+        lists[FromEnum(type)] = std::span{sprites_list_list[FromEnum(type)], size};
+    }
+
+    if (!clean_hack(rom, cfg[PathType::Asm], lists))
+        return EXIT_FAILURE;
+
+    if (!tasks.wait(shared_routines_task))
         return EXIT_FAILURE;
+    io.print("%d Shared routines registered in \"%s\"\n", routine_count, cfg[PathType::Routines].c_str());
+    g_memory_files.push_back(g_shared_patch.vfile());
+    g_memory_files.push_back(g_shared_inscrc_patch.vfile());
 
-    if (!create_shared_patch(cfg[PathType::Routines], cfg))
+    if (run_plugin_stage(&plugins::plugin::before_sprite_patching, pixi_plugin_before_sprite_patching) !=
+        EXIT_SUCCESS) {
         return EXIT_FAILURE;
+    }
 
     int normal_sprites_size = cfg.PerLevel ? MAX_SPRITE_COUNT : 0x100;
+    if (!tasks.wait(extra_defines_task))
+        return EXIT_FAILURE;
 
     if (cfg.AllSpritesOnePatch) {
         {
@@ -1836,6 +2816,9 @@ PIXI_EXPORT int pixi_run(int argc, const char** argv, bool skip_first) {
         }
     }
 
+    if (!g_stable_placement.clean_unused(rom))
+        return EXIT_FAILURE;
+
     if (!check_warnings())
         return EXIT_FAILURE;
 
@@ -1852,8 +2835,9 @@ PIXI_EXPORT int pixi_run(int argc, const char** argv, bool skip_first) {
 #endif
     const auto& asm_path = cfg[PathType::Asm];
     std::vector<patchfile> binfiles{};
-    binfiles.push_back(write_all(versionflag, asm_path, "_versionflag.bin", 4));
     if (cfg.PerLevel) {
+        if (!build_per_level_blocks())
+            return EXIT_FAILURE;
         binfiles.push_back(write_all(PLS_LEVEL_PTRS, asm_path, "_perlevellvlptrs.bin", 0x400));
         if (PLS_DATA_ADDR == 0) {
             unsigned char dummy[1] = {0xFF};
@@ -1869,28 +2853,54 @@ PIXI_EXPORT int pixi_run(int argc, const char** argv, bool skip_first) {
                         PLS_DATA_ADDR, 0x400 + PLS_SPRITE_PTRS_ADDR + 2 * PLS_DATA_ADDR);
 #endif
         }
-        binfiles.push_back(write_long_table(sprite_list + 0x2000, asm_path, "_defaulttables.bin", 0x100));
+        binfiles.push_back(
+            write_long_table(sprite_list + PER_LEVEL_SPRITE_COUNT, asm_path, "_defaulttables.bin", 0x100));
     } else {
         binfiles.push_back(write_long_table(sprite_list, asm_path, "_defaulttables.bin", 0x100));
     }
-    unsigned char customstatusptrs[0x100 * 15]{};
-    for (int i = 0, j = cfg.PerLevel ? 0x2000 : 0; i < 0x100 * 5; i += 5, j++) {
-        memcpy(customstatusptrs + (i * 3), &sprite_list[j].ptrs, 15);
+    // the custom status pointer table only goes up to the last sprite that actually uses it,
+    // if no sprite uses it it's replaced by the $FFFFFF marker that cleanup already knows to skip.
+    const int status_ptr_count = custom_status_ptr_count(sprite_list);
+    if (status_ptr_count == 0) {
+        unsigned char dummy[3] = {0xFF, 0xFF, 0xFF};
+        binfiles.push_back(write_all(dummy, asm_path, "_customstatusptr.bin", 3));
+    } else {
+        unsigned char customstatusptrs[0x100 * 15]{};
+        for (size_t i = 0, j = cfg.PerLevel ? PER_LEVEL_SPRITE_COUNT : 0; i < static_cast<size_t>(status_ptr_count) * 5;
+             i += 5, j++) {
+            memcpy(customstatusptrs + (i * 3), &sprite_list[j].ptrs, 15);
+        }
+        binfiles.push_back(write_all(customstatusptrs, asm_path, "_customstatusptr.bin", status_ptr_count * 15));
+    }
+    if (status_ptr_count < 0x100) {
+        versionflag[1] |= 0x02;
+        versionflag[2] = static_cast<unsigned char>(status_ptr_count);
+    }
+    binfiles.push_back(write_all(versionflag, asm_path, "_versionflag.bin", 4));
+    add_dispatch_defines(sprite_list, status_ptr_count);
+
+    std::array<size_t, FromEnum(ListType::__SIZE__)> misc_counts{};
+    for (const auto& [type, size] : sprite_sizes) {
+        misc_counts[FromEnum(type)] = misc_table_count(type, sprites_list_list[FromEnum(type)]);
     }
-    binfiles.push_back(write_all(customstatusptrs, asm_path, "_customstatusptr.bin", 0x100 * 15));
+    add_misc_count_defines(misc_counts);
+    auto misc_count = [&misc_counts](ListType type) { return misc_counts[FromEnum(type)]; };
 
-    binfiles.push_back(write_sprite_generic(cluster_list, "_clusterptr.bin"));
-    binfiles.push_back(write_sprite_generic(extended_list, "_extendedptr.bin"));
-    binfiles.push_back(write_sprite_generic(minor_extended_list, "_minorextendedptr.bin"));
-    binfiles.push_back(write_sprite_generic(smoke_list, "_smokeptr.bin"));
-    binfiles.push_back(write_sprite_generic(bounce_list, "_bounceptr.bin"));
-    binfiles.push_back(write_sprite_generic(spinningcoin_list, "_spinningcoinptr.bin"));
-    binfiles.push_back(write_sprite_generic(score_list, "_scoreptr.bin"));
+    binfiles.push_back(write_sprite_generic(cluster_list, misc_count(ListType::Cluster), "_clusterptr.bin"));
+    binfiles.push_back(write_sprite_generic(extended_list, misc_count(ListType::Extended), "_extendedptr.bin"));
+    binfiles.push_back(
+        write_sprite_generic(minor_extended_list, misc_count(ListType::MinorExtended), "_minorextendedptr.bin"));
+    binfiles.push_back(write_sprite_generic(smoke_list, misc_count(ListType::Smoke), "_smokeptr.bin"));
+    binfiles.push_back(write_sprite_generic(bounce_list, misc_count(ListType::Bounce), "_bounceptr.bin"));
+    binfiles.push_back(
+        write_sprite_generic(spinningcoin_list, misc_count(ListType::SpinningCoin), "_spinningcoinptr.bin"));
+    binfiles.push_back(write_sprite_generic(score_list, misc_count(ListType::Score), "_scoreptr.bin"));
 
     uint8_t file[SPRITE_COUNT * 3]{};
-    for (size_t i = 0; i < SPRITE_COUNT; i++)
+    const size_t cape_count = misc_count(ListType::Extended);
+    for (size_t i = 0; i < cape_count; i++)
         memcpy(file + (i * 3), &extended_list[i].extended_cape_ptr, 3);
-    binfiles.push_back(write_all(file, asm_path, "_extendedcapeptr.bin", SPRITE_COUNT * 3));
+    binfiles.push_back(write_all(file, asm_path, "_extendedcapeptr.bin", static_cast<unsigned int>(cape_count * 3)));
 
     // more?
 #ifdef DEBUGMSG
@@ -1904,134 +2914,133 @@ PIXI_EXPORT int pixi_run(int argc, const char** argv, bool skip_first) {
     //------------------------------------------------------------------------------------------
 
     // extra byte size file
-    // plus data for .ssc, .mwt, .mw2 files
+    // plus data for .ssc, .mwt, .mw2 files, those are generated while asar applies the core patches
     unsigned char extra_bytes[0x200]{};
 
+    task_graph::task_id lm_data_task{};
     if (!cfg.DisableAllExtensionFiles) {
-        FILE* s16 = open_subfile(rom, "s16", "wb");
-        FILE* ssc = open_subfile(rom, "ssc", "w");
-        FILE* mwt = open_subfile(rom, "mwt", "w");
-        FILE* mw2 = open_subfile(rom, "mw2", "wb");
-
-        if (!cfg[ExtType::Ssc].empty()) {
-            std::ifstream fin(cfg[ExtType::Ssc].c_str());
-            std::string line;
-            while (std::getline(fin, line)) {
-                fprintf(ssc, "%s\n", line.c_str());
-            }
-            fin.close();
-        }
-
-        if (!cfg[ExtType::Mwt].empty()) {
-            std::ifstream fin(cfg[ExtType::Mwt].c_str());
-            std::string line;
-            while (std::getline(fin, line)) {
-                fprintf(mwt, "%s\n", line.c_str());
-            }
-            fin.close();
-        }
-
-        if (!cfg[ExtType::Mw2].empty()) {
-            FILE* fp = open(cfg[ExtType::Mw2].c_str(), "rb");
-            if (fp == nullptr)
-                return EXIT_FAILURE;
-            size_t fs_size = file_size(fp);
-            if (fs_size == 0) {
-                // if size == 0, it means that the file is empty, so we just append the 0x00 and go on with our lives
-                fputc(0x00, mw2);
-            } else {
-                fs_size--; // -1 to skip the 0xFF byte at the end
-                auto mw2_data = std::make_unique<unsigned char[]>(fs_size);
-                size_t read_size = fread(mw2_data.get(), 1, fs_size, fp);
-                if (read_size != fs_size) {
-                    fclose(fp);
-                    io.error("Couldn't fully read file %s, please check file permissions", cfg[ExtType::Mw2].c_str());
-                    return EXIT_FAILURE;
-                }
-                fwrite(mw2_data.get(), 1, fs_size, mw2);
-            }
-            fclose(fp);
-        } else {
-            fputc(0x00, mw2); // binary data starts with 0x00
-        }
-
-        if (!cfg[ExtType::S16].empty())
-            read_map16(map, cfg[ExtType::S16].c_str());
-
-        if (!generate_lm_data(sprite_list, map, extra_bytes, ssc, mwt, mw2, s16, cfg.PerLevel))
-            return EXIT_FAILURE;
-
+        generate_extra_bytes(sprite_list, extra_bytes, cfg.PerLevel, cfg.PerLevelSlots);
         binfiles.push_back(write_all(extra_bytes, asm_path, "_customsize.bin", 0x200));
-        // close all the files.
-        fclose(s16);
-        fclose(ssc);
-        fclose(mwt);
-        fclose(mw2);
+        lm_data_task = tasks.add(
+            "LM data",
+            [&] {
+                return generate_lm_data(sprite_list, map, *ssc, *mwt, *mw2, *s16, cfg.PerLevel, cfg.PerLevelSlots);
+            },
+            {lm_base_files_task});
     }
 
     // apply the actual patches
     using namespace std::string_view_literals;
     std::array patch_names{"main.asm"sv,   "cluster.asm"sv, "extended.asm"sv,     "minorextended.asm"sv,
                            "bounce.asm"sv, "smoke.asm"sv,   "spinningcoin.asm"sv, "score.asm"sv};
-    for (const auto& binfile : binfiles) {
-        g_memory_files.push_back(binfile.vfile());
-    }
+    std::vector<std::string> core_files{};
     for (auto& patch_name : patch_names) {
-        if (!patch(asm_path, patch_name.data(), rom)) {
-            return EXIT_FAILURE;
-        }
+        core_files.push_back(asm_path + std::string{patch_name});
     }
 
-    std::vector<std::string> extraHijacks = listExtraAsm(cfg.AsmDirPath + "/ExtraHijacks", failed);
-    if (failed)
+    if (!tasks.wait(extra_hijacks_task))
         return EXIT_FAILURE;
 
-    if (!extraHijacks.empty()) {
-        io.debug("-------- ExtraHijacks prints --------\n", "");
+    if (run_plugin_stage(&plugins::plugin::before_core_patches, pixi_plugin_before_core_patches) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+
+    // the ExtraHijacks are skipped along with the core patches, so they're part of the hash too
+    std::vector<std::string> hashed_files{core_files};
+    hashed_files.insert(hashed_files.end(), extraHijacks.begin(), extraHijacks.end());
+    const std::optional<uint32_t> core_hash =
+        hash_core_inputs(hashed_files, binfiles, plugin_context.added_files(), rom);
+    unsigned char core_hash_bytes[4]{};
+    for (int i = 0; i < 4; i++)
+        core_hash_bytes[i] = static_cast<unsigned char>(core_hash.value_or(0) >> (i * 8));
+    binfiles.push_back(write_all(core_hash_bytes, asm_path, "_corehash.bin", 4));
+    for (const auto& binfile : binfiles) {
+        g_memory_files.push_back(binfile.vfile());
     }
-    for (std::string patchUri : extraHijacks) {
-        if (!patch(patchUri.c_str(), rom))
-            return EXIT_FAILURE;
-        int count_extra_prints = 0;
-        auto prints = asar_getprints(&count_extra_prints);
-        for (int i = 0; i < count_extra_prints; i++) {
-            io.debug("From file \"%s\": %s\n", patchUri.c_str(), prints[i]);
-        }
+
+    if (core_hash && can_skip_core_patches(*core_hash, rom) && update_core_tables(binfiles, rom)) {
+        io.debug("Core patches unchanged (hash %08X), only their tables were updated\n", *core_hash);
+    } else if (!patch_core_files(core_files, rom) || !patch_extra_hijacks(extraHijacks, rom)) {
+        return EXIT_FAILURE;
     }
 
     if (!check_warnings())
         return EXIT_FAILURE;
 
+    if (run_plugin_stage(&plugins::plugin::after_rom_patching, pixi_plugin_after_rom_patching) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+
     // patch(paths[ASM], "asm/overworld.asm", rom);
 
     //------------------------------------------------------------------------------------------
     // clean up (if necessary)
     //------------------------------------------------------------------------------------------
 
+    if (!cfg.DisableAllExtensionFiles && !tasks.wait(lm_data_task))
+        return EXIT_FAILURE;
+
     io.print("\nAll sprites applied successfully!\n");
 
+    // like the rom, these are only written once everything else succeeded
+    if (!cfg.SymbolsType.empty()) {
+        std::string symbols_path{fs::path{rom.name}.replace_extension(".sym").generic_string()};
+        g_symbols.write_symbols(outputs.add(symbols_path, true), cfg.SymbolsType);
+        io.debug("Collected %zu symbols for %s\n", g_symbols.symbols().size(), symbols_path.c_str());
+    }
+    if (!cfg.SymbolsIndexFile.empty())
+        g_symbols.write_index(outputs.add(cfg.SymbolsIndexFile));
+
+    if (!cfg.ManifestFile.empty())
+        write_manifest(outputs.add(cfg.ManifestFile, true), rom.name, lists, g_inserted_routines);
+
+    if (cfg.ProfileFrames > 0)
+        profile_sprites(rom, std::span{sprite_list, MAX_SPRITE_COUNT}, g_routine_names, cfg.ProfileFrames);
+
     if (!cfg.ExtModDisabled)
-        if (!create_lm_restore(rom.name.data()))
+        if (!create_lm_restore(rom.name.data(), outputs))
             return EXIT_FAILURE;
-    rom.close();
-    int retval = 0;
     if (!cfg.DisableMeiMei) {
         meimei.configureSa1Def(cfg.AsmDirPath + "/sa1def.asm");
-        retval = meimei.run();
+        meimei.configureThreads(static_cast<unsigned>(cfg.Threads));
+        if (meimei.run(rom) != 0)
+            return EXIT_FAILURE;
     }
 
     if (!check_warnings())
         return EXIT_FAILURE;
 
+    if (run_plugin_stage(&plugins::plugin::after_meimei, pixi_plugin_after_meimei) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+
+    // asar is told not to update the checksum after every patch, it's done once here instead
+    rom.fix_checksum();
+    const std::span<const unsigned char> final_rom{rom.data, static_cast<size_t>(rom.size + rom.header_size)};
+    if (!cfg.BpsFile.empty())
+        write_bps_patch(outputs.add(cfg.BpsFile), original_rom, final_rom);
+    if (!cfg.IpsFile.empty() && !write_ips_patch(outputs.add(cfg.IpsFile), original_rom, final_rom))
+        return EXIT_FAILURE;
+    if (!cfg.PatchOnly)
+        outputs.add(rom.name).write(final_rom.data(), final_rom.size());
+    if (!outputs.commit())
+        return EXIT_FAILURE;
+    plugin_context.set_rom(nullptr);
+
+    // these hooks don't get a context, so they can only look at what has been written to disk
     if (plugins::for_each_plugin(plugin_list, &plugins::plugin::after_patching) != EXIT_SUCCESS) {
         return EXIT_FAILURE;
     };
 
+    const io_stats file_stats = get_io_stats();
+    io.debug("File I/O: read %llu bytes from %llu files, wrote %llu bytes to %llu files, %.2f ms\n",
+             static_cast<unsigned long long>(file_stats.bytes_read),
+             static_cast<unsigned long long>(file_stats.files_read),
+             static_cast<unsigned long long>(file_stats.bytes_written),
+             static_cast<unsigned long long>(file_stats.files_written), file_stats.nanoseconds / 1e6);
+
 #ifdef ON_WINDOWS
     if (!lm_handle.empty()) {
         uint32_t IParam = (verification_code << 16) + 2; // reload rom
         PostMessage(window_handle, 0xBECB, 0, IParam);
     }
 #endif
-    return retval;
+    return EXIT_SUCCESS;
 }
@@ -6,9 +6,11 @@
 #endif
 #include "file_io.h"
 #include "iohandler.h"
+#include <algorithm>
 #include <cctype>
 #include <cstring>
 #include <iomanip>
+#include <mutex>
 #include <sstream>
 #include <filesystem>
 
@@ -22,7 +24,7 @@ bool patchfile::s_meimei_keep = false;
 bool patchfile::s_pixi_keep = false;
 
 patchfile::patchfile(const std::string& path, patchfile::openflags mode, bool from_mei_mei)
-    : m_fs_path{path}, m_data_stream{static_cast<std::ios::openmode>(mode)}, m_from_meimei{from_mei_mei} {
+    : m_fs_path{path}, m_from_meimei{from_mei_mei} {
     m_vfile = std::make_unique<memoryfile>();
     m_binary = (static_cast<std::ios::openmode>(mode) & std::ios::binary) != 0;
     std::transform(path.begin(), path.end(), std::back_inserter(m_path),
@@ -31,7 +33,7 @@ patchfile::patchfile(const std::string& path, patchfile::openflags mode, bool fr
 
 patchfile::patchfile(patchfile&& other) noexcept
     : m_fs_path{std::move(other.m_fs_path)}, m_path{std::move(other.m_path)},
-      m_data_stream{std::move(other.m_data_stream)}, m_data{std::move(other.m_data)},
+      m_buffer{std::move(other.m_buffer)}, m_data{std::move(other.m_data)},
       m_from_meimei{other.m_from_meimei}, m_binary{other.m_binary} {
     m_vfile = std::move(other.m_vfile);
     m_vfile->buffer = m_data.c_str();
@@ -44,30 +46,16 @@ void patchfile::set_keep(bool pixi, bool meimei) {
     s_pixi_keep = pixi;
 }
 
-void patchfile::fprintf(const char* format, ...) {
-    va_list list{};
-    va_list copy{};
-    va_start(list, format);
-    va_copy(copy, list);
-    size_t needed_space = std::vsnprintf(nullptr, 0, format, list);
-    std::string buf{};
-    buf.resize(needed_space);
-    std::vsnprintf(buf.data(), buf.size() + 1, format, copy);
-    va_end(list);
-    va_end(copy);
-    m_data_stream << buf;
-}
-
 void patchfile::fwrite(const char* bindata, size_t size) {
-    m_data_stream.write(bindata, size);
+    m_buffer.append(bindata, size);
 }
 
 void patchfile::fwrite(const unsigned char* bindata, size_t size) {
-    m_data_stream.write(reinterpret_cast<const char*>(bindata), size);
+    m_buffer.append(reinterpret_cast<const char*>(bindata), size);
 }
 
 void patchfile::close() {
-    m_data = m_data_stream.str();
+    m_data = m_buffer;
     m_vfile->buffer = m_data.c_str();
     m_vfile->length = m_data.size();
     m_vfile->path = m_path.c_str();
@@ -77,11 +65,9 @@ patchfile::~patchfile() {
     if (m_path.empty())
         return;
     if (m_from_meimei ? s_meimei_keep : s_pixi_keep) {
-        FILE* fp = open(m_fs_path.c_str(), m_binary ? "wb" : "w");
-        if (fp == nullptr)
-            return;
-        ::fwrite(m_vfile->buffer, sizeof(char), m_vfile->length, fp);
-        fclose(fp);
+        file_writer writer{m_fs_path, !m_binary};
+        writer.write(m_vfile->buffer, m_vfile->length);
+        (void)writer.commit();
     } else {
         fs::path filepath{m_fs_path};
         if (fs::exists(filepath)) {
@@ -91,7 +77,7 @@ patchfile::~patchfile() {
 }
 
 void patchfile::clear() {
-    m_data_stream.str("");
+    m_buffer.clear();
     m_data.clear();
     m_vfile.reset(new memoryfile);
 }
@@ -101,30 +87,86 @@ bool ROM::open(std::string n) {
     return open();
 }
 
-void ROM::close() {
-    FILE* romfile = fopen(name.c_str(), "wb");
-    if (romfile == nullptr)
+namespace {
+// buffers of closed ROMs, reused by the next ROM that is opened: MeiMei opens the ROM again right after pixi closes
+// it and library hosts call pixi_run over and over, so the 16MB buffers asar patches in place are only allocated
+// (and their pages faulted in) once.
+class rom_buffer_pool {
+    static constexpr size_t MAX_POOLED = 3;
+    struct buffer {
+        std::unique_ptr<unsigned char[]> data;
+        size_t size;
+    };
+    std::mutex m_mutex{};
+    std::vector<buffer> m_buffers{};
+
+  public:
+    // the buffer isn't cleared, size is updated with the actual size of the buffer
+    unsigned char* acquire(size_t& size) {
+        std::lock_guard lock{m_mutex};
+        auto best = m_buffers.end();
+        for (auto it = m_buffers.begin(); it != m_buffers.end(); ++it) {
+            if (it->size >= size && (best == m_buffers.end() || it->size < best->size))
+                best = it;
+        }
+        if (best == m_buffers.end())
+            return new unsigned char[size];
+        size = best->size;
+        unsigned char* data = best->data.release();
+        m_buffers.erase(best);
+        return data;
+    }
+    void release(unsigned char* data, size_t size) {
+        if (data == nullptr)
+            return;
+        std::lock_guard lock{m_mutex};
+        m_buffers.push_back({std::unique_ptr<unsigned char[]>{data}, size});
+        if (m_buffers.size() > MAX_POOLED) {
+            auto smallest = std::min_element(m_buffers.begin(), m_buffers.end(),
+                                             [](const buffer& a, const buffer& b) { return a.size < b.size; });
+            m_buffers.erase(smallest);
+        }
+    }
+} g_rom_buffers{};
+} // namespace
+
+void ROM::release() {
+    g_rom_buffers.release(data, static_cast<size_t>(capacity + header_size));
+    data = nullptr;
+    real_data = nullptr;
+    capacity = 0;
+}
+
+void ROM::reserve(int new_capacity) {
+    if (new_capacity <= capacity)
         return;
-    fwrite(data, sizeof(char), size + header_size, romfile);
-    fclose(romfile);
-    delete[] data;
-    data = nullptr; // assign to nullptr so that when the dtor is called and these already got freed the delete[] is a
-                    // no-op
+    size_t buffer_size = static_cast<size_t>(new_capacity + header_size);
+    unsigned char* buffer = g_rom_buffers.acquire(buffer_size);
+    memcpy(buffer, data, static_cast<size_t>(size + header_size));
+    release();
+    data = buffer;
+    real_data = data + header_size;
+    capacity = static_cast<int>(buffer_size) - header_size;
+}
+
+char* ROM::asar_buffer() {
+    reserve(MAX_ROM_SIZE);
+    return reinterpret_cast<char*>(real_data);
 }
 
 bool ROM::open() {
-    FILE* file = ::open(name.data(), "r+b"); // call global open
-    if (file == nullptr) {
-        data = nullptr;
+    release();
+    file_buffer file{};
+    if (!file.open(name))
         return false;
-    }
-    size = static_cast<int>(file_size(file));
+    size = static_cast<int>(file.size());
     header_size = size & 0x7FFF;
     size -= header_size;
-    data = read_all(name.data(), false, MAX_ROM_SIZE + header_size);
-    if (data == nullptr)
-        return false;
-    fclose(file);
+    // only the rom itself for now, asar_buffer() grows it when the rom gets patched
+    size_t buffer_size = file.size();
+    data = g_rom_buffers.acquire(buffer_size);
+    capacity = static_cast<int>(buffer_size) - header_size;
+    memcpy(data, file.data(), file.size());
     real_data = data + header_size;
     if (real_data[0x7fd5] == 0x23) {
         if (real_data[0x7fd7] == 0x0D) {
@@ -234,8 +276,43 @@ bool ROM::is_exlevel() const {
     return get_lm_version() > LM_version_exlevel;
 }
 
+// bit 4 of the map mode byte is the speed bit, only meaningful for lorom since sa-1 code runs on its own clock
+bool ROM::is_fastrom() const {
+    return mapper == MapperType::lorom && (real_data[0x7fd5] & 0x10) == 0x10;
+}
+
+// same algorithm as asar: roms whose size isn't a power of 2 are assumed to be the sum of two powers of 2
+// and the smaller part is counted as many times as needed to mirror it up to the bigger one
+void ROM::fix_checksum() {
+    const int checksum_address = snes_to_pc(0x00FFDC, false);
+    real_data[checksum_address] = 0xFF;
+    real_data[checksum_address + 1] = 0xFF;
+    real_data[checksum_address + 2] = 0x00;
+    real_data[checksum_address + 3] = 0x00;
+    unsigned int checksum = 0;
+    if ((size & (size - 1)) == 0) {
+        for (int i = 0; i < size; i++)
+            checksum += real_data[i];
+    } else {
+        int first_part = 1;
+        while (first_part * 2 < size)
+            first_part *= 2;
+        const int second_part = size - first_part;
+        unsigned int second_sum = 0;
+        for (int i = 0; i < first_part; i++)
+            checksum += real_data[i];
+        for (int i = first_part; i < size; i++)
+            second_sum += real_data[i];
+        checksum += second_sum * static_cast<unsigned int>(first_part / second_part);
+    }
+    real_data[checksum_address] = static_cast<unsigned char>((checksum & 0xFF) ^ 0xFF);
+    real_data[checksum_address + 1] = static_cast<unsigned char>(((checksum >> 8) & 0xFF) ^ 0xFF);
+    real_data[checksum_address + 2] = static_cast<unsigned char>(checksum & 0xFF);
+    real_data[checksum_address + 3] = static_cast<unsigned char>((checksum >> 8) & 0xFF);
+}
+
 ROM::~ROM() {
-    delete[] data;
+    release();
 }
 
 bool is_empty_table(std::span<sprite> sprites) {
@@ -326,6 +403,8 @@ void sprite::clear() {
     extended_cape_ptr = DEFAULT_PTR;
     byte_count = 0;
     extra_byte_count = 0;
+    insert_size = -1;
+    routines.clear();
 
     directory.clear();
     asm_file.clear();
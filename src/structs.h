@@ -7,6 +7,7 @@
 #include "asar/asar.h"
 #endif
 #include "config.h"
+#include "format.h"
 #include <cstring>
 #include <memory>
 #include <span>
@@ -21,16 +22,20 @@ constexpr auto RTL_BANK = 0x01;
 constexpr auto RTL_HIGH = 0x80;
 constexpr auto RTL_LOW = 0x21;
 
-// 0x10 per level, 0x200 level + 0x100 global
-constexpr size_t MAX_SPRITE_COUNT = 0x2100;
-constexpr size_t SPRITE_COUNT = 0x80; // count for other sprites like cluster, ow, extended
+// with -pl, the first PER_LEVEL_SPRITE_COUNT entries of the normal sprite list hold the per-level sprites in list.txt
+// order and the global sprites follow them
+constexpr size_t PER_LEVEL_SPRITE_COUNT = 0x2000;
+constexpr size_t MAX_SPRITE_COUNT = PER_LEVEL_SPRITE_COUNT + 0x100;
+constexpr size_t SPRITE_COUNT = 0x80; // max count for other sprites like cluster, ow, extended
+// sizes of the minor extended/bounce/smoke and spinning coin/score tables before they were sized by the sprites they
+// hold, only needed to clean roms patched by those versions
 constexpr size_t LESS_SPRITE_COUNT = 0x3F;
 constexpr size_t MINOR_SPRITE_COUNT = 0x1F;
 
 class patchfile {
     std::string m_fs_path{};
     std::string m_path{};
-    std::stringstream m_data_stream{};
+    std::string m_buffer{}; // written to by fprintf/fwrite, copied to m_data by close()
     std::string m_data{};
     std::unique_ptr<memoryfile> m_vfile;
     bool m_from_meimei = false;
@@ -64,7 +69,9 @@ class patchfile {
     const memoryfile& vfile() const {
         return *m_vfile;
     }
-    void fprintf(const char* format, ...);
+    template <typename... Args> void fprintf(format_string<Args...> format, const Args&... args) {
+        format_to(m_buffer, format, args...);
+    }
     void fwrite(const char* bindata, size_t size);
     void fwrite(const unsigned char* bindata, size_t size);
     void close();
@@ -197,6 +204,10 @@ struct sprite {
     pointer extended_cape_ptr;
     uint8_t byte_count = 0;
     uint8_t extra_byte_count = 0;
+    // bytes assembled in the sprite's code block, -1 if it couldn't be measured (e.g. the file ends in another block)
+    int insert_size = -1;
+    // shared routines called or inlined by the sprite, in order of first use
+    std::vector<std::string> routines{};
 
     std::string directory{};
     std::string asm_file{};
@@ -223,11 +234,20 @@ struct ROM {
     std::string name;
     int size{0};
     int header_size{0};
+    int capacity{0}; // bytes available after real_data
     MapperType mapper{MapperType::lorom};
 
+    ROM() = default;
+    ROM(const ROM&) = delete;
+    ROM& operator=(const ROM&) = delete;
+
     [[nodiscard]] bool open(std::string n);
     [[nodiscard]] bool open();
-    void close();
+    // makes room for at least new_capacity bytes after real_data, keeping the contents
+    void reserve(int new_capacity);
+    // buffer to give to asar_patch_ex with a buflen of MAX_ROM_SIZE, asar only patches in place when the buffer
+    // is that big (otherwise it allocates and copies a buffer of that size on every patch)
+    [[nodiscard]] char* asar_buffer();
 
     int pc_to_snes(int address, bool header = true) const;
     int snes_to_pc(int address, bool header = true) const;
@@ -239,7 +259,12 @@ struct ROM {
     void read_data(unsigned char* dst, size_t size, int addr) const;
     int get_lm_version() const;
     bool is_exlevel() const;
+    bool is_fastrom() const;
+    void fix_checksum();
     ~ROM();
+
+  private:
+    void release();
 };
 
 bool is_empty_table(std::span<sprite> sprites);
@@ -0,0 +1,69 @@
+#include "symbols.h"
+#include "file_io.h"
+#include <algorithm>
+
+void symbol_collector::add(std::string_view name, int address) {
+    // asar reports labels that never got a value as -1
+    if (address < 0 || name.empty())
+        return;
+    m_symbols.push_back({address, std::string{name}});
+    m_sorted = false;
+}
+
+void symbol_collector::clear() {
+    m_symbols.clear();
+    m_sorted = true;
+}
+
+void symbol_collector::sort_unique() {
+    if (m_sorted)
+        return;
+    std::sort(m_symbols.begin(), m_symbols.end());
+    m_symbols.erase(std::unique(m_symbols.begin(), m_symbols.end()), m_symbols.end());
+    m_sorted = true;
+}
+
+const std::vector<symbol_collector::symbol>& symbol_collector::symbols() {
+    sort_unique();
+    return m_symbols;
+}
+
+void symbol_collector::write_symbols(file_writer& file, std::string_view type) {
+    sort_unique();
+    // same layouts as the files produced by asar_getsymbolsfile
+    if (type == "wla") {
+        file.write("; wla symbolic information file\n; generated by pixi\n\n[labels]\n");
+        for (const auto& [address, name] : m_symbols)
+            file.printf("%02X:%04X %s\n", (address >> 16) & 0xFF, address & 0xFFFF, name.c_str());
+    } else {
+        file.write(";no$sns symbolic information file\n;generated by pixi\n;\n");
+        for (const auto& [address, name] : m_symbols)
+            file.printf("%08X %s\n", address, name.c_str());
+    }
+}
+
+static void put_u32(std::vector<unsigned char>& out, uint32_t value) {
+    for (int i = 0; i < 4; i++)
+        out.push_back(static_cast<unsigned char>(value >> (i * 8)));
+}
+
+void symbol_collector::write_index(file_writer& file) {
+    sort_unique();
+    std::vector<unsigned char> entries{};
+    std::vector<unsigned char> strings{};
+    entries.reserve(m_symbols.size() * 8);
+    for (const auto& [address, name] : m_symbols) {
+        put_u32(entries, static_cast<uint32_t>(address));
+        put_u32(entries, static_cast<uint32_t>(strings.size()));
+        strings.insert(strings.end(), name.begin(), name.end());
+        strings.push_back('\0');
+    }
+    std::vector<unsigned char> header{std::begin(INDEX_MAGIC), std::end(INDEX_MAGIC)};
+    put_u32(header, INDEX_VERSION);
+    put_u32(header, static_cast<uint32_t>(m_symbols.size()));
+    put_u32(header, static_cast<uint32_t>(strings.size()));
+
+    file.write(header.data(), header.size());
+    file.write(entries.data(), entries.size());
+    file.write(strings.data(), strings.size());
+}
@@ -0,0 +1,57 @@
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class file_writer;
+
+/**
+    Collects the labels of every asar invocation of a run (core patches, sprites, shared routines)
+    so they can be written as a single symbols file instead of one file per patch.
+    The same label is usually seen many times (e.g. shared routines and core labels are visible to every sprite
+    patch), only one copy of each name/address pair is kept.
+
+    The binary index written by write_index() is meant for tools that need to resolve addresses quickly,
+    every value is little endian:
+        0x00    "PXSY"
+        0x04    u32 format version (1)
+        0x08    u32 number of entries
+        0x0C    u32 size of the string table
+        0x10    entries, sorted by address then by name, 8 bytes each:
+                    u32 SNES address
+                    u32 offset of the NUL-terminated name in the string table
+        ...     string table
+*/
+class symbol_collector {
+  public:
+    struct symbol {
+        int address;
+        std::string name;
+        auto operator<=>(const symbol&) const = default;
+    };
+
+  private:
+    std::vector<symbol> m_symbols{};
+    bool m_sorted = true;
+
+    void sort_unique();
+
+  public:
+    static constexpr char INDEX_MAGIC[4]{'P', 'X', 'S', 'Y'};
+    static constexpr uint32_t INDEX_VERSION = 1;
+
+    void add(std::string_view name, int address);
+    void clear();
+    [[nodiscard]] const std::vector<symbol>& symbols();
+
+    /**
+        @param file is where the symbols file is written, it's up to the caller to commit it
+        @param type is either "wla" or "nocash"
+    */
+    void write_symbols(file_writer& file, std::string_view type);
+    void write_index(file_writer& file);
+};
+
+#endif
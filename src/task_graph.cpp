@@ -0,0 +1,118 @@
+#include "task_graph.h"
+#include "iohandler.h"
+#include <algorithm>
+#include <exception>
+
+task_graph::task_graph(unsigned threads) {
+    m_max_workers = threads != 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+}
+
+task_graph::~task_graph() {
+    (void)wait_all();
+    {
+        std::lock_guard lock{m_mutex};
+        m_stopping = true;
+    }
+    m_work_available.notify_all();
+    for (std::thread& worker : m_workers)
+        worker.join();
+}
+
+task_graph::task_id task_graph::add(std::string name, std::function<bool()> work,
+                                    std::initializer_list<task_id> dependencies) {
+    std::lock_guard lock{m_mutex};
+    const task_id id = m_tasks.size();
+    task& added = m_tasks.emplace_back(task{std::move(name), std::move(work)});
+    bool dependency_failed = false;
+    for (task_id dependency : dependencies) {
+        task& other = m_tasks[dependency];
+        if (other.state == task_state::failed) {
+            dependency_failed = true;
+        } else if (other.state != task_state::succeeded) {
+            other.dependents.push_back(id);
+            added.remaining++;
+        }
+    }
+    if (dependency_failed) {
+        // unfinished dependencies may still list it as a dependent, finish() skips the tasks that aren't pending
+        added.remaining = 0;
+        finish(id, false);
+    } else if (added.remaining == 0) {
+        make_ready(id);
+    }
+    return id;
+}
+
+bool task_graph::wait(task_id id) {
+    std::unique_lock lock{m_mutex};
+    m_task_finished.wait(lock, [&] {
+        return m_tasks[id].state == task_state::succeeded || m_tasks[id].state == task_state::failed;
+    });
+    return m_tasks[id].state == task_state::succeeded;
+}
+
+bool task_graph::wait_all() {
+    std::unique_lock lock{m_mutex};
+    bool all_succeeded = true;
+    for (const task& t : m_tasks) {
+        m_task_finished.wait(lock,
+                             [&] { return t.state == task_state::succeeded || t.state == task_state::failed; });
+        all_succeeded = all_succeeded && t.state == task_state::succeeded;
+    }
+    return all_succeeded;
+}
+
+// called with m_mutex held
+void task_graph::make_ready(task_id id) {
+    m_tasks[id].state = task_state::ready;
+    m_ready.push_back(id);
+    if (m_idle_workers == 0 && m_workers.size() < m_max_workers)
+        m_workers.emplace_back(&task_graph::worker, this);
+    else
+        m_work_available.notify_one();
+}
+
+// called with m_mutex held
+void task_graph::finish(task_id id, bool succeeded) {
+    task& finished = m_tasks[id];
+    finished.state = succeeded ? task_state::succeeded : task_state::failed;
+    finished.work = nullptr;
+    for (task_id dependent : finished.dependents) {
+        task& other = m_tasks[dependent];
+        if (other.state != task_state::pending)
+            continue;
+        if (!succeeded) {
+            finish(dependent, false);
+        } else if (--other.remaining == 0) {
+            make_ready(dependent);
+        }
+    }
+    m_task_finished.notify_all();
+}
+
+void task_graph::worker() {
+    std::unique_lock lock{m_mutex};
+    while (true) {
+        m_idle_workers++;
+        m_work_available.wait(lock, [&] { return m_stopping || !m_ready.empty(); });
+        m_idle_workers--;
+        if (m_ready.empty())
+            return;
+        const task_id id = m_ready.front();
+        m_ready.pop_front();
+        task& current = m_tasks[id];
+        current.state = task_state::running;
+        std::function<bool()> work = std::move(current.work);
+        lock.unlock();
+
+        bool succeeded = false;
+        try {
+            succeeded = work();
+        } catch (const std::exception& e) {
+            iohandler::get_global().error("%s failed: %s\n", current.name, e.what());
+        }
+
+        lock.lock();
+        finish(id, succeeded);
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef TASK_GRAPH_H
+#define TASK_GRAPH_H
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+    Runs tasks on a small pool of worker threads as soon as every task they depend on has finished.
+    Tasks can be added while others are already running, depending on a task that has already finished is fine.
+    A task fails by returning false (or throwing), every task that depends on it then fails without running.
+
+    asar keeps global state and isn't thread safe, so only work that doesn't go through asar (reading input files,
+    building patch text, serializing tables) is given to the graph, the main thread keeps calling asar and waits
+    for the tasks whose results it needs.
+*/
+class task_graph {
+  public:
+    using task_id = size_t;
+
+    // threads is the maximum number of workers, 0 means one per hardware thread, workers are only started when needed
+    explicit task_graph(unsigned threads = 0);
+    task_graph(const task_graph&) = delete;
+    task_graph& operator=(const task_graph&) = delete;
+    // waits for every task, the tasks usually reference locals of the function that owns the graph
+    ~task_graph();
+
+    task_id add(std::string name, std::function<bool()> work, std::initializer_list<task_id> dependencies = {});
+    // blocks until the task has finished, returns whether it succeeded
+    [[nodiscard]] bool wait(task_id id);
+    [[nodiscard]] bool wait_all();
+
+  private:
+    enum class task_state { pending, ready, running, succeeded, failed };
+    struct task {
+        std::string name;
+        std::function<bool()> work;
+        std::vector<task_id> dependents{};
+        size_t remaining = 0; // dependencies that haven't finished yet
+        task_state state = task_state::pending;
+    };
+
+    std::mutex m_mutex{};
+    std::condition_variable m_work_available{};
+    std::condition_variable m_task_finished{};
+    std::deque<task> m_tasks{}; // deque so that tasks don't move when new ones are added
+    std::deque<task_id> m_ready{};
+    std::vector<std::thread> m_workers{};
+    unsigned m_max_workers;
+    unsigned m_idle_workers = 0;
+    bool m_stopping = false;
+
+    void make_ready(task_id id);
+    void finish(task_id id, bool succeeded);
+    void worker();
+};
+
+#endif
@@ -1,9 +1,17 @@
+#include "cpu65816.h"
+#include "delta_patch.h"
+#include "file_io.h"
+#include "iohandler.h"
 #include "pixi_api.h"
+#include "profiler.h"
+#include "structs.h"
+#include <algorithm>
 #include <array>
 #include <filesystem>
 #include <fstream>
 #include <gtest/gtest.h>
 #include <string>
+#include <iterator>
 #include <string_view>
 #include <vector>
 
@@ -70,6 +78,319 @@ auto copy_file_wrap(const fs::path& from, const fs::path& to) {
 }
 #endif
 
+using bytes = std::vector<unsigned char>;
+
+bytes read_binary(const fs::path& path) {
+    std::ifstream file{path, std::ios::binary};
+    return bytes{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+}
+
+// the output rom of a full run without its copier header, addresses are LoROM like base.smc
+struct test_rom {
+    bytes data;
+    explicit test_rom(const fs::path& path) : data{read_binary(path)} {
+        data.erase(data.begin(), data.begin() + static_cast<std::ptrdiff_t>(data.size() & 0x7FFF));
+    }
+    static size_t pc(int snes) {
+        return static_cast<size_t>(((snes & 0x7F0000) >> 1) | (snes & 0x7FFF));
+    }
+    int byte(int snes) const {
+        return data[pc(snes)];
+    }
+    int word(int snes) const {
+        return byte(snes) | (byte(snes + 1) << 8);
+    }
+    int pointer(int snes) const {
+        return word(snes) | (byte(snes + 2) << 16);
+    }
+};
+
+// applies a BPS patch the way patchers do, the checksums at the end are left out
+bytes apply_bps(const bytes& source, const bytes& patch) {
+    size_t pos = 4;
+    auto number = [&] {
+        uint64_t value = 0;
+        uint64_t shift = 1;
+        while (true) {
+            const unsigned char x = patch[pos++];
+            value += (x & 0x7F) * shift;
+            if (x & 0x80)
+                return value;
+            shift <<= 7;
+            value += shift;
+        }
+    };
+    auto offset = [&] {
+        const uint64_t value = number();
+        return (value & 1 ? -1 : 1) * static_cast<int64_t>(value >> 1);
+    };
+    (void)number(); // source size
+    bytes target(number());
+    pos += number(); // metadata
+    size_t out = 0;
+    int64_t source_relative = 0;
+    int64_t target_relative = 0;
+    while (pos < patch.size() - 12) {
+        const uint64_t command = number();
+        size_t length = (command >> 2) + 1;
+        switch (command & 3) {
+        case 0: // source read
+            for (; length > 0; length--, out++)
+                target[out] = source[out];
+            break;
+        case 1: // target read
+            for (; length > 0; length--)
+                target[out++] = patch[pos++];
+            break;
+        case 2: // source copy
+            source_relative += offset();
+            for (; length > 0; length--)
+                target[out++] = source[source_relative++];
+            break;
+        case 3: // target copy
+            target_relative += offset();
+            for (; length > 0; length--)
+                target[out++] = target[target_relative++];
+            break;
+        }
+    }
+    return target;
+}
+
+// applies an IPS patch the way patchers do, including the truncation record after "EOF"
+bytes apply_ips(const bytes& source, const bytes& patch) {
+    bytes target = source;
+    size_t pos = 5;
+    auto read = [&](int count) {
+        size_t value = 0;
+        for (int i = 0; i < count; i++)
+            value = (value << 8) | patch[pos++];
+        return value;
+    };
+    while (std::string_view{reinterpret_cast<const char*>(patch.data()) + pos, 3} != "EOF") {
+        const size_t offset = read(3);
+        size_t size = read(2);
+        const bool run = size == 0;
+        if (run)
+            size = read(2);
+        if (target.size() < offset + size)
+            target.resize(offset + size);
+        for (size_t i = 0; i < size; i++)
+            target[offset + i] = run ? patch[pos] : patch[pos + i];
+        pos += run ? 1 : size;
+    }
+    pos += 3;
+    if (patch.size() - pos == 3)
+        target.resize(read(3));
+    return target;
+}
+
+// a rom sized source with changes spread over it, one of them on the offset IPS reads as its "EOF" marker
+std::pair<bytes, bytes> delta_patch_buffers(size_t target_size) {
+    bytes source(0x500000);
+    for (size_t i = 0; i < source.size(); i++)
+        source[i] = static_cast<unsigned char>((i * 7) ^ (i >> 9));
+    bytes target = source;
+    target.resize(target_size, 0xFF);
+    for (size_t i : {0x10ull, 0x11ull, 0x8000ull, 0x8003ull, 0x454F45ull, 0x454F46ull, 0x454F47ull}) {
+        if (i < target.size())
+            target[i] ^= 0x5A;
+    }
+    std::fill_n(target.begin() + 0x20000, 0x300, 0x00); // a run long enough for both formats
+    return {source, target};
+}
+
+bytes write_delta_patch(const bytes& source, const bytes& target, bool bps) {
+    const char* path = bps ? "delta_test.bps" : "delta_test.ips";
+    {
+        file_writer out{path};
+        if (bps)
+            write_bps_patch(out, source, target);
+        else
+            EXPECT_TRUE(write_ips_patch(out, source, target));
+        EXPECT_TRUE(out.commit());
+    }
+    return read_binary(path);
+}
+
+// a flat 16MB address space for the cpu tests, code and data are written straight into it
+class flat_bus final : public snes_bus {
+  public:
+    bytes memory = bytes(0x1000000);
+    uint8_t read(uint32_t address) override {
+        return memory[address];
+    }
+    void write(uint32_t address, uint8_t value) override {
+        memory[address] = value;
+    }
+    void load(uint32_t address, std::initializer_list<uint8_t> code) {
+        std::copy(code.begin(), code.end(), memory.begin() + address);
+    }
+};
+
+struct cpu_run {
+    uint64_t cycles;
+    int instructions;
+};
+
+// runs from start until the pc reaches end, the timings in the tests are the ones of the WDC datasheet
+cpu_run run_cpu(cpu65816& cpu, uint32_t start, uint32_t end) {
+    cpu.PB = static_cast<uint8_t>(start >> 16);
+    cpu.PC = static_cast<uint16_t>(start);
+    int instructions = 0;
+    while (static_cast<uint32_t>((cpu.PB << 16) | cpu.PC) != end && cpu.stopped == cpu_stop::none &&
+           instructions < 1000) {
+        cpu.step();
+        instructions++;
+    }
+    return {cpu.cycles, instructions};
+}
+
+TEST(PixiUnitTests, BpsPatch) {
+    for (size_t target_size : {0x500000ull, 0x600000ull, 0x300000ull}) {
+        const auto [source, target] = delta_patch_buffers(target_size);
+        const bytes patch = write_delta_patch(source, target, true);
+        ASSERT_EQ(std::string_view(reinterpret_cast<const char*>(patch.data()), 4), "BPS1");
+        EXPECT_TRUE(apply_bps(source, patch) == target);
+    }
+}
+
+TEST(PixiUnitTests, IpsPatch) {
+    // the last one is smaller than the source, the patch ends with a truncation record
+    for (size_t target_size : {0x500000ull, 0x600000ull, 0x300000ull}) {
+        const auto [source, target] = delta_patch_buffers(target_size);
+        const bytes patch = write_delta_patch(source, target, false);
+        ASSERT_EQ(std::string_view(reinterpret_cast<const char*>(patch.data()), 5), "PATCH");
+        EXPECT_TRUE(apply_ips(source, patch) == target);
+    }
+}
+
+TEST(PixiUnitTests, OutputTransaction) {
+    auto contents = [](const fs::path& path) {
+        const bytes data = read_binary(path);
+        return std::string{data.begin(), data.end()};
+    };
+    auto commit = [](std::string_view first, std::string_view second) {
+        output_transaction outputs{};
+        outputs.add("OutputTransactionA.txt").write(first);
+        outputs.add("OutputTransactionB.txt").write(second);
+        return outputs.commit();
+    };
+    ASSERT_TRUE(commit("old a", "old b"));
+    // a directory where the backup of B goes makes moving B out of the way fail after A was moved already
+    fs::create_directories("OutputTransactionB.txt.bak.tmp/blocker");
+    EXPECT_FALSE(commit("new a", "new b"));
+    // the error about B would otherwise show up in the pixi_last_error of the next tests
+    iohandler::init();
+    EXPECT_EQ(contents("OutputTransactionA.txt"), "old a");
+    EXPECT_EQ(contents("OutputTransactionB.txt"), "old b");
+    EXPECT_FALSE(fs::exists("OutputTransactionA.txt.bak.tmp"));
+    EXPECT_FALSE(fs::exists("OutputTransactionA.txt.tmp"));
+    EXPECT_FALSE(fs::exists("OutputTransactionB.txt.tmp"));
+    fs::remove_all("OutputTransactionB.txt.bak.tmp");
+    EXPECT_TRUE(commit("new a", "new b"));
+    EXPECT_EQ(contents("OutputTransactionA.txt"), "new a");
+    EXPECT_EQ(contents("OutputTransactionB.txt"), "new b");
+    EXPECT_FALSE(fs::exists("OutputTransactionA.txt.bak.tmp"));
+    EXPECT_FALSE(fs::exists("OutputTransactionB.txt.bak.tmp"));
+}
+
+TEST(PixiUnitTests, CpuLoopTimings) {
+    flat_bus bus{};
+    cpu65816 cpu{bus};
+    // LDX #$05 / loop: LDA #$12 / STA $0100,x / DEX / BNE loop
+    bus.load(0x008000, {0xA2, 0x05, 0xA9, 0x12, 0x9D, 0x00, 0x01, 0xCA, 0xD0, 0xF8});
+    cpu.reset_native();
+    cpu_run run = run_cpu(cpu, 0x008000, 0x00800A);
+    // LDX 2, 5 times LDA 2 + STA abs,x 5 + DEX 2, BNE 3 when taken and 2 the last time
+    EXPECT_EQ(run.cycles, 2u + 5u * (2 + 5 + 2) + 4u * 3 + 2);
+    EXPECT_EQ(run.instructions, 1 + 5 * 4);
+    for (uint32_t address = 0x0101; address <= 0x0105; address++)
+        EXPECT_EQ(bus.memory[address], 0x12);
+    EXPECT_EQ(bus.memory[0x0100], 0x00);
+
+    // REP #$30 / LDX #$0004 / loop: LDA #$1234 / STA $0200,x / DEX / DEX / BNE loop / SEP #$30
+    bus.load(0x008100,
+             {0xC2, 0x30, 0xA2, 0x04, 0x00, 0xA9, 0x34, 0x12, 0x9D, 0x00, 0x02, 0xCA, 0xCA, 0xD0, 0xF6, 0xE2, 0x30});
+    cpu.reset_native();
+    run = run_cpu(cpu, 0x008100, 0x008111);
+    // REP 3, LDX # 3, 2 times LDA # 3 + STA abs,x 6 + DEX 2 + DEX 2, BNE 3 then 2, SEP 3
+    EXPECT_EQ(run.cycles, 3u + 3 + 2u * (3 + 6 + 2 + 2) + 3 + 2 + 3);
+    EXPECT_EQ(run.instructions, 2 + 2 * 5 + 1);
+    EXPECT_EQ(bus.memory[0x0202], 0x34);
+    EXPECT_EQ(bus.memory[0x0203], 0x12);
+    EXPECT_EQ(bus.memory[0x0204], 0x34);
+    EXPECT_EQ(bus.memory[0x0205], 0x12);
+}
+
+TEST(PixiUnitTests, CpuBranchPageCrossing) {
+    flat_bus bus{};
+    cpu65816 cpu{bus};
+    // BRA +$10 right at the end of a page, it lands on $00810E
+    bus.load(0x0080FC, {0x80, 0x10});
+    cpu.reset_native();
+    EXPECT_EQ(run_cpu(cpu, 0x0080FC, 0x00810E).cycles, 3u);
+    // emulation mode takes one more cycle for the page crossing
+    cpu.reset_native();
+    cpu.E = true;
+    EXPECT_EQ(run_cpu(cpu, 0x0080FC, 0x00810E).cycles, 4u);
+    // BNE not taken is 2 cycles either way
+    bus.load(0x0080FC, {0xD0, 0x10});
+    cpu.reset_native();
+    cpu.P |= cpu65816::FLAG_Z;
+    EXPECT_EQ(run_cpu(cpu, 0x0080FC, 0x0080FE).cycles, 2u);
+}
+
+TEST(PixiUnitTests, CpuJslRtl) {
+    flat_bus bus{};
+    cpu65816 cpu{bus};
+    // JSL $018000 / ... $018000: LDA #$01 / RTL
+    bus.load(0x008000, {0x22, 0x00, 0x80, 0x01});
+    bus.load(0x018000, {0xA9, 0x01, 0x6B});
+    cpu.reset_native();
+    const uint16_t stack = cpu.S;
+    const cpu_run run = run_cpu(cpu, 0x008000, 0x008004);
+    // JSL 8, LDA # 2, RTL 6
+    EXPECT_EQ(run.cycles, 8u + 2 + 6);
+    EXPECT_EQ(run.instructions, 3);
+    EXPECT_EQ(cpu.S, stack);
+    EXPECT_EQ(cpu.A & 0xFF, 0x01);
+    EXPECT_EQ(cpu.PB, 0x00);
+}
+
+TEST(PixiUnitTests, ProfilerCycles) {
+    try {
+        copy_file_wrap("base.smc", "ProfilerCycles.smc");
+    } catch (const fs::filesystem_error& error) {
+        std::cout << "Error happened while copying the files: " << error.what() << '\n';
+        EXPECT_FALSE(true);
+        return;
+    }
+    ROM rom{};
+    ASSERT_TRUE(rom.open("ProfilerCycles.smc"));
+    // INIT: LDA #$01 / RTL, MAIN: LDX #$03 / loop: DEX / BNE loop / RTL
+    constexpr std::array<unsigned char, 9> code{0xA9, 0x01, 0x6B, 0xA2, 0x03, 0xCA, 0xD0, 0xFD, 0x6B};
+    std::copy(code.begin(), code.end(), rom.real_data + rom.snes_to_pc(0x1F8000, false));
+    std::array<sprite, 1> sprites{};
+    sprites[0].asm_file = "timing.asm";
+    sprites[0].table.type = 1;
+    sprites[0].table.init = pointer{0x1F8000};
+    sprites[0].table.main = pointer{0x1F8003};
+
+    iohandler::init();
+    profile_sprites(rom, sprites, {}, 2);
+    int size = 0;
+    pixi_string_array output = pixi_output(&size);
+    bool found = false;
+    for (int i = 0; i < size; i++) {
+        // INIT is LDA # 2 + RTL 6, MAIN is LDX # 2 + 3 DEX + BNE taken twice and not taken once + RTL 6
+        found = found || std::string_view{output[i]}.find("00 timing.asm: INIT 8, MAIN avg 22 max 22 over 2 frame(s)") !=
+                             std::string_view::npos;
+    }
+    EXPECT_TRUE(found);
+    iohandler::init();
+}
+
 TEST(PixiUnitTests, CFGParsing) {
     WinCheckMemLeak leakchecker{};
     pixi_sprite_t cfg_spr = pixi_parse_cfg_sprite("test.cfg");
@@ -168,6 +489,44 @@ TEST(PixiUnitTests, PixiFullRun) {
     EXPECT_EQ(pixi_run(sizeof(argv) / sizeof(argv[0]), argv, false), EXIT_SUCCESS);
 }
 
+TEST(PixiUnitTests, PixiStablePlacement) {
+    try {
+        copy_file_wrap("base.smc", "PixiStablePlacement.smc");
+        copy_file_wrap("test.json", "sprites/test.json");
+        copy_file_wrap("test.asm", "sprites/test.asm");
+        copy_file_wrap("test.cfg", "sprites/test.cfg");
+    } catch (const fs::filesystem_error& error) {
+        std::cout << "Error happened while copying the files: " << error.what() << '\n';
+        EXPECT_FALSE(true);
+        return;
+    }
+    {
+        std::ofstream list_file{"list.txt", std::ios::trunc};
+        list_file << "00 test.json\n01 test.cfg";
+    }
+    // INIT and MAIN of sprites 00 and 01 in the global sprite table
+    auto sprite_pointers = [] {
+        const test_rom rom{"PixiStablePlacement.smc"};
+        const int table = rom.pointer(0x02FFEE);
+        std::vector<int> pointers{};
+        for (int number : {0x00, 0x01}) {
+            pointers.push_back(rom.pointer(table + number * 0x10 + 0x08));
+            pointers.push_back(rom.pointer(table + number * 0x10 + 0x0B));
+        }
+        return pointers;
+    };
+    const char* argv[] = {"--stable-placement", "PixiStablePlacement.smc"};
+    ASSERT_EQ(pixi_run(sizeof(argv) / sizeof(argv[0]), argv, false), EXIT_SUCCESS);
+    const std::vector<int> first_run = sprite_pointers();
+    // the second run finds the blocks of the first one and puts the sprites back in them
+    {
+        std::ofstream list_file{"list.txt", std::ios::trunc};
+        list_file << "00 test.json\n01 test.cfg\n02 test.cfg";
+    }
+    ASSERT_EQ(pixi_run(sizeof(argv) / sizeof(argv[0]), argv, false), EXIT_SUCCESS);
+    EXPECT_EQ(sprite_pointers(), first_run);
+}
+
 TEST(PixiUnitTests, PixiPluginTest) {
     try {
         fs::create_directory(fs::current_path() / "plugins");
@@ -225,6 +584,40 @@ TEST(PixiUnitTests, PixiFullRunPerLevel) {
     EXPECT_EQ(pixi_run(sizeof(argv) / sizeof(argv[0]), argv, false), EXIT_SUCCESS);
 }
 
+TEST(PixiUnitTests, PixiFullRunPerLevelRange) {
+    std::string_view list_contents{"BA test.json\n012:90 test.cfg\n012:BA test.json\n105:80 test.cfg"};
+    try {
+        copy_file_wrap("base.smc", "PixiFullRunPerLevelRange.smc");
+        copy_file_wrap("test.json", "sprites/test.json");
+        copy_file_wrap("test.asm", "sprites/test.asm");
+        copy_file_wrap("test.cfg", "sprites/test.cfg");
+    } catch (const fs::filesystem_error& error) {
+        std::cout << "Error happened while copying the files: " << error.what() << '\n';
+        EXPECT_FALSE(true);
+        return;
+    }
+    {
+        std::ofstream list_file{"list.txt", std::ios::trunc};
+        list_file << list_contents;
+    }
+    const char* argv[] = {"-pl", "--perlevel-range", "80-BF", "PixiFullRunPerLevelRange.smc"};
+    ASSERT_EQ(pixi_run(sizeof(argv) / sizeof(argv[0]), argv, false), EXIT_SUCCESS);
+
+    const test_rom rom{"PixiFullRunPerLevelRange.smc"};
+    EXPECT_EQ(rom.byte(0x02FFE7) & 0x04, 0x04); // compact per-level blocks
+    EXPECT_EQ(rom.byte(0x02FFE9), 0x80);
+    const int level_ptrs = rom.pointer(0x02FFF1);
+    const int sprite_ptrs = rom.pointer(0x02FFF4);
+    // each block starts with (highest number - first number + 1) * 2
+    auto block_header = [&](int level) {
+        const int offset = rom.word(level_ptrs + level * 2);
+        return offset == 0 ? 0 : rom.word(sprite_ptrs + offset - 1);
+    };
+    EXPECT_EQ(block_header(0x012), (0xBA - 0x80 + 1) * 2);
+    EXPECT_EQ(block_header(0x105), (0x80 - 0x80 + 1) * 2);
+    EXPECT_EQ(block_header(0x000), 0);
+}
+
 TEST(PixiUnitTests, PixiFullRunPerLevelFail) {
     std::string_view list_contents{"BA test.json\nBA:012 test.json"};
     try {
@@ -251,6 +644,20 @@ TEST(PixiUnitTests, PixiFullRunPerLevelFail) {
     EXPECT_STREQ(error, expected_error.data());
 }
 
+TEST(PixiUnitTests, MiscCapacityFail) {
+    {
+        std::ofstream list_file{"list.txt", std::ios::trunc};
+        list_file << "CLUSTER:\n08 test.asm";
+    }
+    const char* argv[] = {"--misc-capacity", "cluster=8", "PixiFullRun.smc"};
+    EXPECT_EQ(pixi_run(sizeof(argv) / sizeof(argv[0]), argv, false), EXIT_FAILURE);
+    int size = 0;
+    constexpr std::string_view expected_error{"Error on list line 2: Sprite number must be less than 8\n"};
+    pixi_string error = pixi_last_error(&size);
+    EXPECT_EQ(size, expected_error.size());
+    EXPECT_STREQ(error, expected_error.data());
+}
+
 TEST(PixiUnitTests, Disable255PerLevelUnsupported) {
     {
         std::ofstream list_file{"list.txt", std::ios::trunc};